@@ -0,0 +1,265 @@
+//
+// Created by 46769 on 2021-02-20.
+//
+
+#pragma once
+#include "changes.hpp"
+#include <algorithm>
+#include <bit>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+/// The blocks of around BlockSize characters that the per-block indexes (ContentHash, BracketIndex, Utf16Index) split a text into, with their
+/// summaries combined in a segment tree. Block is what an index keeps per block, & Node its summary, which has the block's text length in
+/// length. A default constructed Node must be empty: length 0, & left unchanged by Combine on either side.
+/// Blocks sit in leaf slots with free ones among them (as in a packed memory array), so that an edit which splits or merges blocks doesn't shift
+/// every block after it: a split takes a free slot next to it, or spreads out the blocks of the smallest subtree around it that's sparse
+/// enough, & the tree only grows (doubling its slots) when all of it is half full. That's O(log^2 n) amortized slot moves per split, and
+/// O(log n) node updates for an edit that doesn't split or merge. Blocks are addressed by slot, in text order, but not contiguously
+template<typename Block, typename Node, auto Combine, int BlockSize>
+class BlockTree {
+public:
+    /// Splits text positions [0, length) into blocks. scan(begin, end) returns the Block & Node of text positions [begin, end)
+    template<typename Scan>
+    void rebuild(int length, Scan &&scan) {
+        std::vector<Block> blocks;
+        std::vector<Node> leaves;
+        chunk(0, length, scan, blocks, leaves);
+        reset(std::move(blocks), leaves);
+    }
+
+    void clear() {
+        reset({}, {});
+    }
+
+    /// Rescans the blocks touched by an edit: the ones overlapping the erased text, or containing the insertion point. They're replaced by blocks
+    /// over the same text, edited, & a span that has become too small is merged with the block after it. The text must already contain the edit,
+    /// and be length long
+    template<typename Scan>
+    void on_change(const ChangeEvent &event, int length, Scan &&scan) {
+        if (block_count == 0) {
+            rebuild(length, scan);
+            return;
+        }
+        auto [first, span_begin] = locate(event.offset);
+        if (const auto before = prev(first); before >= 0 && event.offset == span_begin && event.removed == 0) {
+            // inserting at a block boundary, append to the block before it rather than prepend to this one
+            first = before;
+            span_begin -= tree[leaf_base + first].length;
+        }
+        auto [last, last_begin] = locate(std::max(event.offset, event.offset + event.removed - 1));
+        auto span_end = last_begin + tree[leaf_base + last].length;// in old text positions
+        const auto delta = event.inserted - event.removed;
+        if (const auto after = next(last); after >= 0 && span_end + delta - span_begin < BlockSize / 4) {
+            last = after;
+            span_end += tree[leaf_base + last].length;
+        }
+        std::vector<Block> blocks;
+        std::vector<Node> leaves;
+        chunk(span_begin, span_end + delta, scan, blocks, leaves);
+        replace(first, last, blocks, leaves);
+    }
+
+    /// The number of blocks
+    int size() const { return block_count; }
+    bool empty() const { return block_count == 0; }
+    /// The summary of the whole text
+    const Node &root() const { return tree[1]; }
+
+    /// Finds the block containing pos & its first text position. pos == text size maps to the last block
+    std::pair<int, int> locate(int pos) const {
+        const auto [slot, before] = descend([pos](const Node &prefix) { return pos >= prefix.length; });
+        return {slot, before.length};
+    }
+    /// Descends to the block where past(summary of the text before a block) first turns false, returning it & the summary of the text before it.
+    /// past has to be monotonic, & the last block is returned if it never turns false
+    template<typename Past>
+    std::pair<int, Node> descend(Past &&past) const {
+        auto i = 1;
+        Node before{};
+        while (i < leaf_base) {
+            if (tree[2 * i + 1].length == 0) {
+                i = 2 * i;
+                continue;
+            }
+            const auto with_left = Combine(before, tree[2 * i]);
+            if (past(with_left)) {
+                before = with_left;
+                i = 2 * i + 1;
+            } else {
+                i = 2 * i;
+            }
+        }
+        return {i - leaf_base, before};
+    }
+    /// The first text position of the block in slot
+    int start_of(int slot) const {
+        auto start = 0;
+        for (auto i = leaf_base + slot; i > 1; i /= 2) {
+            if (i % 2 == 1) start += tree[i - 1].length;
+        }
+        return start;
+    }
+    /// The slot of the block after / before the one in slot, -1 if there's none
+    int next(int slot) const {
+        auto i = leaf_base + slot;
+        while (i > 1 && (i % 2 == 1 || tree[i + 1].length == 0)) i /= 2;
+        if (i == 1) return -1;
+        for (i++; i < leaf_base;) i = tree[2 * i].length > 0 ? 2 * i : 2 * i + 1;
+        return i - leaf_base;
+    }
+    int prev(int slot) const {
+        auto i = leaf_base + slot;
+        while (i > 1 && (i % 2 == 0 || tree[i - 1].length == 0)) i /= 2;
+        if (i == 1) return -1;
+        for (i--; i < leaf_base;) i = tree[2 * i + 1].length > 0 ? 2 * i + 1 : 2 * i;
+        return i - leaf_base;
+    }
+
+    Block &block(int slot) { return blocks[slot]; }
+    const Block &block(int slot) const { return blocks[slot]; }
+    const Node &leaf(int slot) const { return tree[leaf_base + slot]; }
+    /// The segment tree, for descents of its own: root at 1, the leaf of slot at slot_count() + slot. Free slots are empty Nodes
+    const Node &node(int index) const { return tree[index]; }
+    int slot_count() const { return leaf_base; }
+
+    /// Calls f(block, leaf, start) for every block, in text order
+    template<typename F>
+    void for_each(F &&f) { for_each_block(*this, f); }
+    template<typename F>
+    void for_each(F &&f) const { for_each_block(*this, f); }
+
+private:
+    template<typename Self, typename F>
+    static void for_each_block(Self &self, F &f) {
+        for (auto slot = 0, start = 0; slot < self.leaf_base; slot++) {
+            if (self.tree[self.leaf_base + slot].length == 0) continue;
+            f(self.blocks[slot], self.tree[self.leaf_base + slot], start);
+            start += self.tree[self.leaf_base + slot].length;
+        }
+    }
+
+    template<typename Scan>
+    static void chunk(int begin, int end, Scan &scan, std::vector<Block> &blocks, std::vector<Node> &leaves) {
+        const auto length = end - begin;
+        if (length <= 0) return;
+        // blocks of even size, between BlockSize / 2 & 2 * BlockSize
+        const auto count = std::max(1, (length + BlockSize / 2) / BlockSize);
+        for (auto i = 0; i < count; i++) {
+            const auto b = begin + static_cast<int>(static_cast<long long>(length) * i / count);
+            const auto e = begin + static_cast<int>(static_cast<long long>(length) * (i + 1) / count);
+            auto [block, leaf] = scan(b, e);
+            blocks.push_back(std::move(block));
+            leaves.push_back(leaf);
+        }
+    }
+
+    /// Lays out blocks over twice as many slots
+    void reset(std::vector<Block> &&blocks, const std::vector<Node> &leaves) {
+        block_count = static_cast<int>(leaves.size());
+        leaf_base = static_cast<int>(std::bit_ceil(static_cast<unsigned>(std::max(2 * block_count, 2))));
+        height = std::countr_zero(static_cast<unsigned>(leaf_base));
+        tree.assign(2 * leaf_base, Node{});
+        this->blocks.assign(leaf_base, Block{});
+        spread(0, leaf_base, blocks, leaves);
+    }
+
+    /// Most blocks a window of width slots may hold: all of them for a single slot, down to half of them for the whole tree
+    int capacity(int width) const {
+        const auto level = std::countr_zero(static_cast<unsigned>(width));
+        return static_cast<int>(static_cast<long long>(width) * (2 * height - level) / (2 * height));
+    }
+
+    int occupied(int begin, int end) const {
+        auto result = 0;
+        for (auto slot = begin; slot < end; slot++) result += tree[leaf_base + slot].length > 0;
+        return result;
+    }
+
+    /// Replaces the blocks in slots [first, last], both of which hold one, with blocks
+    void replace(int first, int last, std::vector<Block> &blocks, std::vector<Node> &leaves) {
+        const auto added = static_cast<int>(leaves.size());
+        const auto removed = occupied(first, last + 1);
+        block_count += added - removed;
+        if (added <= last - first + 1) {
+            for (auto slot = first; slot <= last; slot++) {
+                const auto i = slot - first;
+                this->blocks[slot] = i < added ? std::move(blocks[i]) : Block{};
+                tree[leaf_base + slot] = i < added ? leaves[i] : Node{};
+            }
+            update(first, last + 1);
+            // many merges leave the tree mostly free slots, lay it out again at its size
+            if (leaf_base > 2 && 8 * block_count < leaf_base) relayout(0, leaf_base, first, last, {}, {});
+            return;
+        }
+        // find the smallest subtree around [first, last] that has room for the new blocks at its density, & spread its blocks out evenly
+        auto begin = first, width = 1, in_window = 1;
+        while (begin + width <= last || in_window - removed + added > capacity(width)) {
+            if (width == leaf_base) {
+                relayout(0, leaf_base, first, last, std::move(blocks), leaves, true);
+                return;
+            }
+            const auto sibling = (begin / width) % 2 == 0 ? begin + width : begin - width;
+            in_window += occupied(sibling, sibling + width);
+            begin = std::min(begin, sibling);
+            width *= 2;
+        }
+        relayout(begin, begin + width, first, last, std::move(blocks), leaves);
+    }
+
+    /// Spreads the blocks in slots [begin, end) out evenly over them, with the ones in [first, last] replaced by blocks. Lays out the whole tree
+    /// afresh, at twice as many slots as blocks, if grow is set or the range covers every slot
+    void relayout(int begin, int end, int first, int last, std::vector<Block> &&blocks, const std::vector<Node> &leaves, bool grow = false) {
+        std::vector<Block> window_blocks;
+        std::vector<Node> window_leaves;
+        const auto take = [&](int from, int to) {
+            for (auto slot = from; slot < to; slot++) {
+                if (tree[leaf_base + slot].length == 0) continue;
+                window_blocks.push_back(std::move(this->blocks[slot]));
+                window_leaves.push_back(tree[leaf_base + slot]);
+            }
+        };
+        take(begin, first);
+        if (!leaves.empty()) {
+            std::move(blocks.begin(), blocks.end(), std::back_inserter(window_blocks));
+            window_leaves.insert(window_leaves.end(), leaves.begin(), leaves.end());
+        } else {
+            take(first, last + 1);
+        }
+        take(last + 1, end);
+        if (grow || (begin == 0 && end == leaf_base)) {
+            reset(std::move(window_blocks), window_leaves);
+            return;
+        }
+        spread(begin, end, window_blocks, window_leaves);
+    }
+
+    /// Places blocks evenly over slots [begin, end), freeing the others, & updates the tree above them
+    void spread(int begin, int end, std::vector<Block> &blocks, const std::vector<Node> &leaves) {
+        const auto width = end - begin;
+        const auto n = static_cast<long long>(leaves.size());
+        std::fill(tree.begin() + leaf_base + begin, tree.begin() + leaf_base + end, Node{});
+        for (auto i = 0; i < n; i++) {
+            const auto slot = begin + static_cast<int>(i * width / n);
+            this->blocks[slot] = std::move(blocks[i]);
+            tree[leaf_base + slot] = leaves[i];
+        }
+        update(begin, end);
+    }
+
+    /// Recombines the tree nodes above slots [begin, end)
+    void update(int begin, int end) {
+        for (auto l = (leaf_base + begin) / 2, r = (leaf_base + end - 1) / 2; l > 0; l /= 2, r /= 2) {
+            for (auto i = l; i <= r; i++) tree[i] = Combine(tree[2 * i], tree[2 * i + 1]);
+        }
+    }
+
+    std::vector<Block> blocks = std::vector<Block>(2);
+    /// Segment tree, root at 1, leaves from leaf_base on
+    std::vector<Node> tree = std::vector<Node>(4);
+    int leaf_base{2};
+    /// log2(leaf_base)
+    int height{1};
+    int block_count{0};
+};
@@ -0,0 +1,196 @@
+//
+// Created by 46769 on 2021-02-17.
+//
+
+#include "brackets.hpp"
+#include "gap_buffer.hpp"
+#include "line_index.hpp"
+#include "simd.hpp"
+#include <algorithm>
+
+namespace {
+    constexpr std::array<char, 6> BracketChars{'(', ')', '[', ']', '{', '}'};
+
+    int kind_of(char ch) {
+        switch (ch) {
+            case '(':
+            case ')':
+                return 0;
+            case '[':
+            case ']':
+                return 1;
+            default:
+                return 2;
+        }
+    }
+}// namespace
+
+BracketIndex::Node BracketIndex::combine(const Node &left, const Node &right) {
+    Node node{left.length + right.length};
+    for (auto k = 0; k < Kinds; k++) {
+        node.depth[k].net = left.depth[k].net + right.depth[k].net;
+        node.depth[k].min = std::min(left.depth[k].min, left.depth[k].net + right.depth[k].min);
+    }
+    return node;
+}
+
+std::pair<BracketIndex::Block, BracketIndex::Node> BracketIndex::scan(const GapBuffer &buffer, int begin, int end) {
+    Block block;
+    Node node{end - begin};
+    auto offset = 0;
+    buffer.for_each_segment(begin, end, [&](std::span<const char> segment) {
+        simd::for_each_of(segment, BracketChars, [&](std::size_t i) {
+            const auto ch = segment[i];
+            const auto open = ch == '(' || ch == '[' || ch == '{';
+            const auto kind = kind_of(ch);
+            block.brackets.push_back({static_cast<std::uint16_t>(offset + i), static_cast<std::uint8_t>(kind), open});
+            auto &depth = node.depth[kind];
+            depth.net += open ? 1 : -1;
+            depth.min = std::min(depth.min, depth.net);
+        });
+        offset += static_cast<int>(segment.size());
+    });
+    return {std::move(block), node};
+}
+
+void BracketIndex::rebuild(const GapBuffer &buffer) {
+    blocks.rebuild(buffer.size(), [&buffer](int begin, int end) { return scan(buffer, begin, end); });
+    built = true;
+}
+
+void BracketIndex::build(const GapBuffer &buffer) {
+    if (!built) rebuild(buffer);
+}
+
+void BracketIndex::clear() {
+    built = false;
+    blocks.clear();
+}
+
+bool BracketIndex::is_built() const {
+    return built;
+}
+
+void BracketIndex::on_change(const ChangeEvent &event, const GapBuffer &buffer) {
+    if (!built) return;
+    blocks.on_change(event, buffer.size(), [&buffer](int begin, int end) { return scan(buffer, begin, end); });
+}
+
+int BracketIndex::descend_forward(int node, int lo, int hi, int from, int kind, int &depth) const {
+    if (hi <= from) return -1;
+    const auto &d = blocks.node(node).depth[kind];
+    if (lo >= from && depth + d.min > 0) {
+        depth += d.net;
+        return -1;
+    }
+    if (node >= blocks.slot_count()) return lo;
+    const auto mid = (lo + hi) / 2;
+    const auto found = descend_forward(2 * node, lo, mid, from, kind, depth);
+    return found >= 0 ? found : descend_forward(2 * node + 1, mid, hi, from, kind, depth);
+}
+
+int BracketIndex::descend_backward(int node, int lo, int hi, int to, int kind, int &depth) const {
+    if (lo >= to) return -1;
+    // read backwards, a node lowers the depth by its net change, and reaches its lowest at min - net
+    const auto &d = blocks.node(node).depth[kind];
+    if (hi <= to && depth + d.min - d.net > 0) {
+        depth -= d.net;
+        return -1;
+    }
+    if (node >= blocks.slot_count()) return lo;
+    const auto mid = (lo + hi) / 2;
+    const auto found = descend_backward(2 * node + 1, mid, hi, to, kind, depth);
+    return found >= 0 ? found : descend_backward(2 * node, lo, mid, to, kind, depth);
+}
+
+std::optional<int> BracketIndex::find_forward(int kind, int pos) const {
+    auto [block, start] = blocks.locate(pos);
+    auto depth = 1;
+    auto from = pos - start + 1;
+    // the scan of pos's block either finds the match, or leaves the depth at its end, for the tree to find the block the match is in
+    for (auto scans = 0; scans < 2; scans++) {
+        const auto &brackets = blocks.block(block).brackets;
+        auto it = std::lower_bound(brackets.begin(), brackets.end(), from, [](const Bracket &b, int offset) { return b.offset < offset; });
+        for (; it != brackets.end(); ++it) {
+            if (it->kind != kind) continue;
+            depth += it->open ? 1 : -1;
+            if (depth == 0) return start + it->offset;
+        }
+        block = descend_forward(1, 0, blocks.slot_count(), block + 1, kind, depth);
+        if (block < 0) break;
+        start = blocks.start_of(block);
+        from = 0;
+    }
+    return {};
+}
+
+std::optional<int> BracketIndex::find_backward(int kind, int pos) const {
+    auto [block, start] = blocks.locate(pos);
+    auto depth = 1;
+    auto to = pos - start;
+    for (auto scans = 0; scans < 2; scans++) {
+        const auto &brackets = blocks.block(block).brackets;
+        auto it = std::lower_bound(brackets.begin(), brackets.end(), to, [](const Bracket &b, int offset) { return b.offset < offset; });
+        while (it != brackets.begin()) {
+            --it;
+            if (it->kind != kind) continue;
+            depth += it->open ? -1 : 1;
+            if (depth == 0) return start + it->offset;
+        }
+        block = descend_backward(1, 0, blocks.slot_count(), block, kind, depth);
+        if (block < 0) break;
+        start = blocks.start_of(block);
+        to = blocks.leaf(block).length;
+    }
+    return {};
+}
+
+std::optional<int> BracketIndex::match(int pos) const {
+    if (blocks.empty() || pos < 0 || pos >= blocks.root().length) return {};
+    const auto [block, start] = blocks.locate(pos);
+    const auto &brackets = blocks.block(block).brackets;
+    const auto it = std::lower_bound(brackets.begin(), brackets.end(), pos - start, [](const Bracket &b, int offset) { return b.offset < offset; });
+    if (it == brackets.end() || start + it->offset != pos) return {};
+    return it->open ? find_forward(it->kind, pos) : find_backward(it->kind, pos);
+}
+
+std::optional<BracketPair> BracketIndex::enclosing(int pos) const {
+    if (blocks.empty() || pos <= 0 || pos > blocks.root().length) return {};
+    std::optional<BracketPair> innermost;
+    for (auto kind = 0; kind < Kinds; kind++) {
+        // an unmatched opening bracket before pos is found as if pos held a closing one
+        const auto open = find_backward(kind, pos);
+        if (!open || (innermost && *open < innermost->open)) continue;
+        if (const auto close = find_forward(kind, *open)) innermost = BracketPair{*open, *close};
+    }
+    return innermost;
+}
+
+std::vector<BracketPair> BracketIndex::fold_regions(const LineIndex &lines) const {
+    std::vector<BracketPair> regions;
+    std::array<std::vector<int>, Kinds> open;
+    blocks.for_each([&](const Block &block, const Node &, int start) {
+        for (const auto &bracket : block.brackets) {
+            auto &stack = open[bracket.kind];
+            const auto pos = start + bracket.offset;
+            if (bracket.open) {
+                stack.push_back(pos);
+            } else if (!stack.empty()) {
+                if (lines.line_of(stack.back()) != lines.line_of(pos)) regions.push_back({stack.back(), pos});
+                stack.pop_back();
+            }
+        }
+    });
+    std::sort(regions.begin(), regions.end(), [](const BracketPair &a, const BracketPair &b) { return a.open < b.open; });
+    return regions;
+}
+
+int BracketIndex::bracket_count() const {
+    auto count = 0;
+    blocks.for_each([&count](const Block &block, const Node &, int) { count += static_cast<int>(block.brackets.size()); });
+    return count;
+}
+
+int BracketIndex::block_count() const {
+    return blocks.size();
+}
@@ -0,0 +1,88 @@
+//
+// Created by 46769 on 2021-02-17.
+//
+
+#pragma once
+#include "block_tree.hpp"
+#include "changes.hpp"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+class GapBuffer;
+class LineIndex;
+
+struct BracketPair {
+    int open;
+    int close;
+    friend bool operator==(const BracketPair &, const BracketPair &) = default;
+};
+
+/// Index of the brackets in a buffer's text ((), [] & {}), for matching brackets & finding the regions they enclose without walking the text.
+/// Like ContentHash, the text is split into blocks of around BlockSize characters. Each block keeps the positions of its brackets, and per
+/// bracket kind the net change in depth over the block & the lowest depth reached in it. Those are combined in a segment tree, so finding where
+/// a depth comes back down to zero is a descent of the tree, plus a scan of the brackets of the blocks at either end. An edit only rescans the
+/// blocks it touched (see BlockTree). Matching is purely structural: a bracket only pairs with one of its own kind, and strings & comments aren't recognized.
+/// Like ContentHash, the blocks are built on first use
+class BracketIndex {
+public:
+    static constexpr int BlockSize = 4096;
+
+    BracketIndex() = default;
+    /// Rebuilds all blocks from the buffer
+    void rebuild(const GapBuffer &buffer);
+    /// Builds the blocks, unless they already are
+    void build(const GapBuffer &buffer);
+    /// Rescans the blocks touched by an edit, if they have been built. buffer must already contain the edit
+    void on_change(const ChangeEvent &event, const GapBuffer &buffer);
+    /// Drops the blocks, until the next build()
+    void clear();
+    bool is_built() const;
+
+    /// Returns the position of the bracket matching the one at pos. nullopt if there's no bracket at pos, or it has no match
+    std::optional<int> match(int pos) const;
+    /// Returns the innermost bracket pair around text position pos, i.e. with open < pos <= close. nullopt if there's none
+    std::optional<BracketPair> enclosing(int pos) const;
+    /// Returns the bracket pairs that span more than one line, ordered by their opening bracket: the regions an editor can fold
+    std::vector<BracketPair> fold_regions(const LineIndex &lines) const;
+    int bracket_count() const;
+    int block_count() const;
+
+private:
+    static constexpr int Kinds = 3;
+    struct Bracket {
+        /// Position within the block. Blocks are never longer than 2 * BlockSize
+        std::uint16_t offset;
+        std::uint8_t kind;
+        bool open;
+    };
+    struct Depth {
+        int net{0};
+        /// The lowest depth reached, relative to the depth at the start. Includes the start itself, so it's never above 0
+        int min{0};
+    };
+    struct Node {
+        int length{0};
+        std::array<Depth, Kinds> depth{};
+    };
+    struct Block {
+        std::vector<Bracket> brackets;
+    };
+
+    static Node combine(const Node &left, const Node &right);
+    /// Collects the brackets of text positions [begin, end) into a block
+    static std::pair<Block, Node> scan(const GapBuffer &buffer, int begin, int end);
+
+    /// Finds where the depth of kind, starting out at 1 right after pos, first drops to 0
+    std::optional<int> find_forward(int kind, int pos) const;
+    /// Finds where the depth of kind, starting out at 1 right before pos & read backwards, first drops to 0
+    std::optional<int> find_backward(int kind, int pos) const;
+    /// Finds the first block from slot from on where depth drops to 0, skipping over (& updating depth for) the blocks before it. -1 if there's none
+    int descend_forward(int node, int lo, int hi, int from, int kind, int &depth) const;
+    /// Finds the last block before to where depth, read backwards, drops to 0. -1 if there's none
+    int descend_backward(int node, int lo, int hi, int to, int kind, int &depth) const;
+
+    bool built{false};
+    BlockTree<Block, Node, &BracketIndex::combine, BlockSize> blocks;
+};
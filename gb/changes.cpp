@@ -0,0 +1,130 @@
+//
+// Created by 46769 on 2021-02-11.
+//
+
+#include "changes.hpp"
+#include <algorithm>
+#include <iterator>
+
+void DirtyRanges::add(const ChangeEvent &event) {
+    if (event.removed == 0 && event.inserted == 0) return;
+    const auto erased_end = event.offset + event.removed;
+    const auto delta = event.inserted - event.removed;
+    DirtyRange touched{event.offset, event.offset + event.inserted};
+    // ranges that end before the edit are left alone, ranges touching it are merged into it, and ranges after it are shifted
+    auto first = std::lower_bound(dirty.begin(), dirty.end(), event.offset, [](const DirtyRange &range, int pos) { return range.end < pos; });
+    auto last = first;
+    for (; last != dirty.end() && last->begin <= erased_end; ++last) {
+        touched.begin = std::min(touched.begin, last->begin);
+        touched.end = std::max(touched.end, std::max(last->end, erased_end) + delta);
+    }
+    for (auto it = last; it != dirty.end(); ++it) {
+        it->begin += delta;
+        it->end += delta;
+    }
+    if (first == last) {
+        dirty.insert(first, touched);
+    } else {
+        *first = touched;
+        dirty.erase(first + 1, last);
+    }
+}
+
+void DirtyRanges::add(std::span<const ChangeEvent> events) {
+    for (const auto &event : events) add(event);
+}
+
+std::span<const DirtyRange> DirtyRanges::ranges() const {
+    return dirty;
+}
+
+bool DirtyRanges::empty() const {
+    return dirty.empty();
+}
+
+void DirtyRanges::clear() {
+    dirty.clear();
+}
+
+ChangeNotifier::Subscription ChangeNotifier::subscribe(ChangeListener listener) {
+    (delivery_depth > 0 ? added : listeners).push_back({next_subscription, std::move(listener)});
+    subscriber_count++;
+    return next_subscription++;
+}
+
+void ChangeNotifier::unsubscribe(Subscription subscription) {
+    const auto find = [subscription](std::vector<Entry> &entries) {
+        const auto it = std::ranges::lower_bound(entries, subscription, {}, &Entry::subscription);
+        return it != entries.end() && it->subscription == subscription && !it->unsubscribed ? it : entries.end();
+    };
+    if (const auto it = find(listeners); it != listeners.end()) {
+        subscriber_count--;
+        if (delivery_depth == 0) {
+            listeners.erase(it);
+        } else {
+            // the listener may be the one being called, it's left in place until the delivery is done
+            it->unsubscribed = true;
+            unsubscribed_count++;
+        }
+    } else if (const auto it = find(added); it != added.end()) {
+        subscriber_count--;
+        added.erase(it);
+    }
+}
+
+bool ChangeNotifier::has_subscribers() const {
+    return subscriber_count > 0;
+}
+
+void ChangeNotifier::begin_transaction() {
+    transaction_depth++;
+}
+
+void ChangeNotifier::end_transaction() {
+    if (transaction_depth == 0 || --transaction_depth > 0) return;
+    if (!batch.empty()) {
+        // swapped out first, so that a listener editing the text starts a batch of its own
+        auto events = std::move(batch);
+        batch.clear();
+        deliver(events);
+    }
+}
+
+void ChangeNotifier::notify(const ChangeEvent &event) {
+    if (transaction_depth == 0) {
+        deliver({&event, 1});
+        return;
+    }
+    if (!batch.empty()) {
+        auto &last = batch.back();
+        const auto typed_after = event.removed == 0 && last.removed == 0 && event.offset == last.offset + last.inserted;
+        const auto deleted_before = event.inserted == 0 && last.inserted == 0 && event.offset + event.removed == last.offset;
+        const auto deleted_at = event.inserted == 0 && last.inserted == 0 && event.offset == last.offset;
+        if (typed_after || deleted_before || deleted_at) {
+            last.offset = std::min(last.offset, event.offset);
+            last.removed += event.removed;
+            last.inserted += event.inserted;
+            last.line_delta += event.line_delta;
+            return;
+        }
+    }
+    batch.push_back(event);
+}
+
+void ChangeNotifier::deliver(std::span<const ChangeEvent> events) {
+    // listeners may subscribe & unsubscribe (themselves too) from inside the call, or edit the text & start a nested delivery. Neither moves
+    // an entry until the outermost delivery is done, so the listener being called stays put
+    delivery_depth++;
+    for (std::size_t i = 0; i < listeners.size(); i++) {
+        if (!listeners[i].unsubscribed) listeners[i].listener(events);
+    }
+    if (--delivery_depth > 0) return;
+    if (unsubscribed_count > 0) {
+        std::erase_if(listeners, [](const Entry &entry) { return entry.unsubscribed; });
+        unsubscribed_count = 0;
+    }
+    if (!added.empty()) {
+        std::ranges::move(added, std::back_inserter(listeners));
+        added.clear();
+    }
+}
@@ -0,0 +1,77 @@
+//
+// Created by 46769 on 2021-02-11.
+//
+
+#pragma once
+#include <functional>
+#include <span>
+#include <vector>
+
+/// Describes one edit: the text positions [offset, offset + removed) were replaced by inserted characters, which changed the line count by line_delta.
+/// Offsets of a batch of events are sequential, i.e. each one refers to the text as it is after the events before it were applied
+struct ChangeEvent {
+    int offset;
+    int removed;
+    int inserted;
+    int line_delta;
+};
+
+/// Receives the events of an edit, or of a whole transaction
+using ChangeListener = std::function<void(std::span<const ChangeEvent> events)>;
+
+/// Text position range [begin, end). An empty range marks a point where text was erased
+struct DirtyRange {
+    int begin;
+    int end;
+};
+
+/// The coalesced set of text ranges touched by a sequence of change events, kept in current text positions. Ranges are sorted & never
+/// overlap or touch, so a consumer that re-scans them does work proportional to what was edited, not to the size of the text
+class DirtyRanges {
+public:
+    void add(const ChangeEvent &event);
+    void add(std::span<const ChangeEvent> events);
+    std::span<const DirtyRange> ranges() const;
+    bool empty() const;
+    void clear();
+
+private:
+    std::vector<DirtyRange> dirty;
+};
+
+/// Fans change events out to subscribers. Inside a transaction events are collected (and consecutive typing or deleting merged) and delivered
+/// as one batch when the outermost transaction ends; outside of one, every edit is delivered by itself. Listeners may subscribe & unsubscribe
+/// from inside a delivery: an unsubscribed listener isn't called anymore, a new one starts with the batches delivered after the current delivery
+class ChangeNotifier {
+public:
+    using Subscription = int;
+
+    Subscription subscribe(ChangeListener listener);
+    void unsubscribe(Subscription subscription);
+    bool has_subscribers() const;
+
+    void begin_transaction();
+    void end_transaction();
+    void notify(const ChangeEvent &event);
+
+private:
+    struct Entry {
+        Subscription subscription;
+        ChangeListener listener;
+        /// Unsubscribed during a delivery, removed once it's done
+        bool unsubscribed{false};
+    };
+
+    void deliver(std::span<const ChangeEvent> events);
+
+    /// Sorted by subscription, as they're handed out in increasing order. Entries don't move during a delivery
+    std::vector<Entry> listeners;
+    /// Subscribed during a delivery, added to listeners once it's done
+    std::vector<Entry> added;
+    int subscriber_count{0};
+    int unsubscribed_count{0};
+    int delivery_depth{0};
+    std::vector<ChangeEvent> batch;
+    Subscription next_subscription{0};
+    int transaction_depth{0};
+};
@@ -0,0 +1,127 @@
+//
+// Created by 46769 on 2021-02-15.
+//
+
+#include "content_hash.hpp"
+#include "gap_buffer.hpp"
+#include <fstream>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+    constexpr std::uint64_t Modulus = (1ull << 61) - 1;
+    constexpr std::uint64_t Base = 0x1f3d5b79a3c6e1ull % Modulus;
+
+    std::uint64_t mul_mod(std::uint64_t a, std::uint64_t b) {
+#ifdef _MSC_VER
+        std::uint64_t high;
+        const auto low = _umul128(a, b, &high);
+#else
+        const auto product = static_cast<unsigned __int128>(a) * b;
+        const auto low = static_cast<std::uint64_t>(product), high = static_cast<std::uint64_t>(product >> 64);
+#endif
+        // product = high * 2^64 + low, and 2^61 == 1 (mod 2^61 - 1)
+        auto result = (low & Modulus) + ((low >> 61) | (high << 3));
+        result = (result & Modulus) + (result >> 61);
+        return result >= Modulus ? result - Modulus : result;
+    }
+
+    std::uint64_t add_mod(std::uint64_t a, std::uint64_t b) {
+        const auto sum = a + b;
+        return sum >= Modulus ? sum - Modulus : sum;
+    }
+
+    /// Continues hash & power over more text
+    void accumulate(std::uint64_t &hash, std::uint64_t &power, std::span<const char> text) {
+        for (auto ch : text) {
+            hash = add_mod(mul_mod(hash, Base), static_cast<unsigned char>(ch) + 1);
+            power = mul_mod(power, Base);
+        }
+    }
+}// namespace
+
+ContentDigest content_digest(std::string_view text) {
+    std::uint64_t hash = 0, power = 1;
+    accumulate(hash, power, text);
+    return {hash, static_cast<std::int64_t>(text.size())};
+}
+
+std::optional<ContentDigest> file_digest(const std::filesystem::path &path) {
+    std::ifstream file{path, std::ios::binary};
+    if (!file) return {};
+    std::vector<char> chunk(1024 * 1024);
+    ContentDigest digest;
+    std::uint64_t power = 1;
+    while (file) {
+        file.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        const auto read = static_cast<std::size_t>(file.gcount());
+        accumulate(digest.hash, power, {chunk.data(), read});
+        digest.length += static_cast<std::int64_t>(read);
+    }
+    if (file.bad()) return {};
+    return digest;
+}
+
+ContentHash::Node ContentHash::combine(const Node &left, const Node &right) {
+    return {add_mod(mul_mod(left.hash, right.power), right.hash), mul_mod(left.power, right.power), left.length + right.length};
+}
+
+std::pair<ContentHash::Block, ContentHash::Node> ContentHash::scan(const GapBuffer &buffer, int begin, int end) {
+    Node node{0, 1, end - begin};
+    buffer.for_each_segment(begin, end, [&node](std::span<const char> segment) { accumulate(node.hash, node.power, segment); });
+    return {Block{}, node};
+}
+
+void ContentHash::rebuild(const GapBuffer &buffer) {
+    blocks.rebuild(buffer.size(), [&buffer](int begin, int end) { return scan(buffer, begin, end); });
+    built = true;
+}
+
+void ContentHash::build(const GapBuffer &buffer) {
+    if (!built) rebuild(buffer);
+}
+
+void ContentHash::clear() {
+    built = false;
+    blocks.clear();
+}
+
+bool ContentHash::is_built() const {
+    return built;
+}
+
+void ContentHash::on_change(const ChangeEvent &event, const GapBuffer &buffer) {
+    if (!built) return;
+    blocks.on_change(event, buffer.size(), [&buffer](int begin, int end) { return scan(buffer, begin, end); });
+}
+
+ContentDigest ContentHash::digest() const {
+    return {blocks.root().hash, blocks.root().length};
+}
+
+void ContentHash::mark_saved() {
+    saved = digest();
+    blocks.for_each([](Block &block, const Node &, int start) { block.saved_offset = start; });
+}
+
+bool ContentHash::modified() const {
+    return digest() != saved;
+}
+
+std::vector<DirtyRange> ContentHash::unsaved_ranges() const {
+    std::vector<DirtyRange> result;
+    blocks.for_each([&result](const Block &block, const Node &leaf, int start) {
+        if (block.saved_offset == start) return;
+        if (!result.empty() && result.back().end == start) {
+            result.back().end += leaf.length;
+        } else {
+            result.push_back({start, start + leaf.length});
+        }
+    });
+    return result;
+}
+
+int ContentHash::block_count() const {
+    return blocks.size();
+}
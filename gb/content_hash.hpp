@@ -0,0 +1,78 @@
+//
+// Created by 46769 on 2021-02-15.
+//
+
+#pragma once
+#include "block_tree.hpp"
+#include "changes.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+class GapBuffer;
+
+/// Hash of a text & its length. Equal digests mean equal texts, bar a collision chance of about length / 2^61
+struct ContentDigest {
+    std::uint64_t hash{0};
+    std::int64_t length{0};
+    friend bool operator==(const ContentDigest &, const ContentDigest &) = default;
+};
+
+/// Computes the digest of text in one go, e.g. of a file's contents, to compare against ContentHash::digest()
+ContentDigest content_digest(std::string_view text);
+/// Streams a file through content_digest(), without loading it whole. Returns nullopt if it couldn't be read
+std::optional<ContentDigest> file_digest(const std::filesystem::path &path);
+
+/// Keeps a digest of a buffer's text, updated per edit. The text is split into blocks of around BlockSize characters, each with a polynomial
+/// hash (mod 2^61 - 1), which are combined in a segment tree. Polynomial hashes compose, hash(a + b) = hash(a) * B^|b| + hash(b), so the
+/// digest doesn't depend on where the block boundaries lie, and equals content_digest() of the same text. An edit only rehashes the blocks it touched,
+/// plus O(log n) tree nodes (see BlockTree). Blocks also remember where they were at the last mark_saved(), so a save can skip everything that's still in place.
+/// The blocks are built on first use, & from then on kept up to date per edit
+class ContentHash {
+public:
+    static constexpr int BlockSize = 4096;
+
+    ContentHash() = default;
+    /// Rebuilds all blocks from the buffer
+    void rebuild(const GapBuffer &buffer);
+    /// Builds the blocks, unless they already are
+    void build(const GapBuffer &buffer);
+    /// Rehashes the blocks touched by an edit, if they have been built. buffer must already contain the edit
+    void on_change(const ChangeEvent &event, const GapBuffer &buffer);
+    /// Drops the blocks, until the next build()
+    void clear();
+    bool is_built() const;
+
+    /// The digest of the whole text, O(1)
+    ContentDigest digest() const;
+    /// Remembers the current text as the saved one (e.g. right after a load or a save)
+    void mark_saved();
+    /// Whether the text differs from the saved one. Edits that are undone by hand count as unmodified again
+    bool modified() const;
+    /// The ranges of the text that are not at the same position with the same contents as at the last mark_saved(), i.e. what a save to the same
+    /// file has to (re)write. If the text got shorter, the file also has to be truncated to size
+    std::vector<DirtyRange> unsaved_ranges() const;
+    int block_count() const;
+
+private:
+    struct Node {
+        std::uint64_t hash{0};
+        /// B^length, so that nodes combine without having to compute powers
+        std::uint64_t power{1};
+        int length{0};
+    };
+    struct Block {
+        /// Text position of the block at the last mark_saved(), -1 if its contents have changed since
+        int saved_offset{-1};
+    };
+
+    static Node combine(const Node &left, const Node &right);
+    /// Hashes text positions [begin, end) into a block
+    static std::pair<Block, Node> scan(const GapBuffer &buffer, int begin, int end);
+
+    bool built{false};
+    BlockTree<Block, Node, &ContentHash::combine, BlockSize> blocks;
+    ContentDigest saved;
+};
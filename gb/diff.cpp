@@ -0,0 +1,238 @@
+//
+// Created by 46769 on 2021-02-10.
+//
+
+#include "diff.hpp"
+#include "gap_buffer.hpp"
+#include "hash.hpp"
+#include "simd.hpp"
+#include "snapshot.hpp"
+#include "text.hpp"
+#include <unordered_map>
+
+DiffInput::DiffInput(const GapBuffer &buffer) : total_size(buffer.size()), pin(buffer.pin_cold_chunks()) {
+    buffer.for_each_segment(0, buffer.size(), [this](std::span<const char> segment) { segments.push_back(segment); });
+}
+
+DiffInput::DiffInput(const Text &text) : DiffInput(text.buffer()) {
+    lines = text.lines().starts();
+}
+
+DiffInput::DiffInput(const SnapshotView &snapshot) : DiffInput(snapshot.text()) {
+    lines = snapshot.line_starts();
+}
+
+DiffInput::DiffInput(std::string_view text) : total_size(static_cast<int>(text.size())) {
+    if (!text.empty()) segments.emplace_back(text.data(), text.size());
+}
+
+/// Walks the segments of both inputs in lock step, comparing the overlapping pieces with simd::common_prefix
+static int common_prefix(const DiffInput &a, const DiffInput &b) {
+    const auto limit = std::min(a.size(), b.size());
+    auto a_spans = a.spans(), b_spans = b.spans();
+    std::size_t ai = 0, bi = 0, a_offset = 0, b_offset = 0;
+    auto pos = 0;
+    while (pos < limit) {
+        const auto sa = a_spans[ai].subspan(a_offset), sb = b_spans[bi].subspan(b_offset);
+        const auto length = std::min({sa.size(), sb.size(), static_cast<std::size_t>(limit - pos)});
+        const auto common = simd::common_prefix(sa.data(), sb.data(), length);
+        pos += static_cast<int>(common);
+        if (common < length) return pos;
+        a_offset += length;
+        b_offset += length;
+        if (a_offset == a_spans[ai].size()) ai++, a_offset = 0;
+        if (b_offset == b_spans[bi].size()) bi++, b_offset = 0;
+    }
+    return pos;
+}
+
+/// Same as common_prefix, from the back, but never further than limit
+static int common_suffix(const DiffInput &a, const DiffInput &b, int limit) {
+    auto a_spans = a.spans(), b_spans = b.spans();
+    auto ai = a_spans.size(), bi = b_spans.size();
+    std::size_t a_left = 0, b_left = 0;// bytes of the current span still to be compared, counted from its start
+    auto pos = 0;
+    while (pos < limit) {
+        if (a_left == 0) a_left = a_spans[--ai].size();
+        if (b_left == 0) b_left = b_spans[--bi].size();
+        const auto length = std::min({a_left, b_left, static_cast<std::size_t>(limit - pos)});
+        const auto common = simd::common_suffix(a_spans[ai].data() + a_left, b_spans[bi].data() + b_left, length);
+        pos += static_cast<int>(common);
+        if (common < length) return pos;
+        a_left -= length;
+        b_left -= length;
+    }
+    return pos;
+}
+
+/// Returns the start of the line text position pos lies on
+static int line_begin(const DiffInput &input, int pos) {
+    if (!input.line_starts().empty()) {
+        const auto starts = input.line_starts();
+        return *(std::upper_bound(starts.begin(), starts.end(), pos) - 1);
+    }
+    auto offset = 0, result = 0;
+    input.for_each_segment(0, pos, [&](std::span<const char> segment) {
+        const auto it = std::find(segment.rbegin(), segment.rend(), '\n');
+        if (it != segment.rend()) result = offset + static_cast<int>(std::distance(it, segment.rend()));
+        offset += static_cast<int>(segment.size());
+    });
+    return result;
+}
+
+static bool starts_line(const DiffInput &input, int pos) {
+    auto result = pos == 0;
+    input.for_each_segment(pos - 1, pos, [&result](std::span<const char> segment) { result = segment[0] == '\n'; });
+    return result;
+}
+
+/// Returns the text position just past the first line break in [begin, end), or end if there is none
+static int next_line_begin(const DiffInput &input, int begin, int end) {
+    auto offset = begin, result = end;
+    input.for_each_segment(begin, end, [&](std::span<const char> segment) {
+        if (result != end) return;
+        const auto it = std::find(segment.begin(), segment.end(), '\n');
+        if (it != segment.end()) result = offset + static_cast<int>(std::distance(segment.begin(), it)) + 1;
+        offset += static_cast<int>(segment.size());
+    });
+    return result;
+}
+
+/// Returns the line number of the line starting at text position pos
+static int line_number(const DiffInput &input, int pos) {
+    if (!input.line_starts().empty()) {
+        const auto starts = input.line_starts();
+        return static_cast<int>(std::lower_bound(starts.begin(), starts.end(), pos) - starts.begin());
+    }
+    auto lines = 0;
+    input.for_each_segment(0, pos, [&](std::span<const char> segment) { lines += static_cast<int>(std::count(segment.begin(), segment.end(), '\n')); });
+    return lines;
+}
+
+/// Splits [begin, end) into lines, returning the start of each line followed by end
+static std::vector<int> split_lines(const DiffInput &input, int begin, int end) {
+    std::vector<int> result{begin};
+    if (!input.line_starts().empty()) {
+        const auto starts = input.line_starts();
+        for (auto it = std::upper_bound(starts.begin(), starts.end(), begin); it != starts.end() && *it < end; ++it) result.push_back(*it);
+    } else {
+        auto offset = begin;
+        input.for_each_segment(begin, end, [&](std::span<const char> segment) {
+            for (auto it = std::find(segment.begin(), segment.end(), '\n'); it != segment.end(); it = std::find(it + 1, segment.end(), '\n')) {
+                const auto next = offset + static_cast<int>(std::distance(segment.begin(), it)) + 1;
+                if (next < end) result.push_back(next);
+            }
+            offset += static_cast<int>(segment.size());
+        });
+    }
+    if (begin < end) result.push_back(end);
+    return result;
+}
+
+static std::vector<int> hash_lines(const DiffInput &input, const std::vector<int> &lines, std::unordered_map<std::uint64_t, int> &ids) {
+    std::vector<int> result;
+    result.reserve(lines.size());
+    for (auto i = 0; i + 1 < static_cast<int>(lines.size()); i++) {
+        Xxh64Stream stream;
+        input.for_each_segment(lines[i], lines[i + 1], [&stream](std::span<const char> segment) { stream.update(segment); });
+        // equal hashes are taken to mean equal lines. With 64 bits, a collision between two lines of the same diff is not a realistic concern
+        result.push_back(ids.try_emplace(stream.digest(), static_cast<int>(ids.size())).first->second);
+    }
+    return result;
+}
+
+/// Myers' O(ND) diff of a & b. Returns the hunks, with line numbers relative to the start of a & b, or nullopt if the edit distance exceeds max_d
+static std::optional<std::vector<DiffHunk>> myers(const std::vector<int> &a, const std::vector<int> &b, int max_d) {
+    const auto n = static_cast<int>(a.size()), m = static_cast<int>(b.size());
+    // trace[d][k + d] is the furthest x reached on diagonal k, with d edits
+    std::vector<std::vector<int>> trace;
+    const auto snake = [&](int x, int k) {
+        auto y = x - k;
+        while (x < n && y < m && a[x] == b[y]) x++, y++;
+        return x;
+    };
+    auto found = false;
+    for (auto d = 0; d <= n + m && !found; d++) {
+        if (d > max_d) return std::nullopt;
+        std::vector<int> v(2 * d + 1);
+        for (auto k = -d; k <= d; k += 2) {
+            int x;
+            if (d == 0) {
+                x = 0;
+            } else {
+                const auto &prev = trace.back();
+                const auto at = [&](int kk) { return prev[kk + d - 1]; };
+                x = (k == -d || (k != d && at(k - 1) < at(k + 1))) ? at(k + 1) : at(k - 1) + 1;
+            }
+            x = snake(x, k);
+            v[k + d] = x;
+            if (x >= n && x - k >= m) {
+                found = true;
+                break;
+            }
+        }
+        trace.push_back(std::move(v));
+    }
+
+    // Walk back from (n, m), collecting the (old, new) line of every deletion & insertion
+    std::vector<DiffHunk> hunks;
+    auto x = n, y = m;
+    for (auto d = static_cast<int>(trace.size()) - 1; d > 0; d--) {
+        const auto &prev = trace[d - 1];
+        const auto at = [&](int kk) { return prev[kk + d - 1]; };
+        const auto k = x - y;
+        const auto down = k == -d || (k != d && at(k - 1) < at(k + 1));
+        const auto prev_k = down ? k + 1 : k - 1;
+        const auto prev_x = at(prev_k), prev_y = prev_x - prev_k;
+        // the edit itself happened at (prev_x, prev_y), everything after it up to (x, y) was a snake of equal lines
+        const auto old_count = down ? 0 : 1, new_count = down ? 1 : 0;
+        if (!hunks.empty() && hunks.back().old_line == prev_x + old_count && hunks.back().new_line == prev_y + new_count && x - prev_x - old_count == 0) {
+            // directly in front of the previously found edit, grow that hunk backwards
+            hunks.back().old_line = prev_x;
+            hunks.back().new_line = prev_y;
+            hunks.back().old_count += old_count;
+            hunks.back().new_count += new_count;
+        } else {
+            hunks.push_back({prev_x, old_count, prev_y, new_count});
+        }
+        x = prev_x;
+        y = prev_y;
+    }
+    std::reverse(hunks.begin(), hunks.end());
+    return hunks;
+}
+
+LineDiff diff_lines(const DiffInput &old_text, const DiffInput &new_text, int max_edit_distance) {
+    LineDiff result;
+    const auto raw_prefix = common_prefix(old_text, new_text);
+    if (raw_prefix == old_text.size() && raw_prefix == new_text.size()) return result;
+
+    // only whole lines are skipped, so back the prefix up to the start of the line it ends in
+    const auto prefix = line_begin(old_text, raw_prefix);
+    auto suffix = common_suffix(old_text, new_text, std::min(old_text.size(), new_text.size()) - prefix);
+    // ... and the suffix forward to just past the first line break in it, unless it already starts a line on both sides
+    if (suffix > 0 && !(starts_line(old_text, old_text.size() - suffix) && starts_line(new_text, new_text.size() - suffix))) {
+        suffix = old_text.size() - next_line_begin(old_text, old_text.size() - suffix, old_text.size());
+    }
+
+    const auto old_lines = split_lines(old_text, prefix, old_text.size() - suffix);
+    const auto new_lines = split_lines(new_text, prefix, new_text.size() - suffix);
+    std::unordered_map<std::uint64_t, int> ids;
+    const auto old_ids = hash_lines(old_text, old_lines, ids);
+    const auto new_ids = hash_lines(new_text, new_lines, ids);
+
+    auto hunks = myers(old_ids, new_ids, max_edit_distance);
+    if (!hunks) hunks = std::vector<DiffHunk>{{0, static_cast<int>(old_ids.size()), 0, static_cast<int>(new_ids.size())}};
+
+    const auto old_first_line = line_number(old_text, prefix);
+    const auto new_first_line = line_number(new_text, prefix);
+    for (const auto &hunk : *hunks) {
+        const auto offset = old_lines[hunk.old_line];
+        const auto removed = old_lines[hunk.old_line + hunk.old_count] - offset;
+        std::string inserted;
+        new_text.for_each_segment(new_lines[hunk.new_line], new_lines[hunk.new_line + hunk.new_count], [&inserted](std::span<const char> segment) { inserted.append(segment.data(), segment.size()); });
+        result.edits.push_back(TextEdit{offset, removed, std::move(inserted)});
+        result.hunks.push_back({hunk.old_line + old_first_line, hunk.old_count, hunk.new_line + new_first_line, hunk.new_count});
+    }
+    return result;
+}
@@ -0,0 +1,68 @@
+//
+// Created by 46769 on 2021-02-10.
+//
+
+#pragma once
+#include "gap_buffer.hpp"
+#include "text_edit.hpp"
+#include <algorithm>
+#include <span>
+#include <string_view>
+#include <vector>
+
+class Text;
+class SnapshotView;
+
+/// One side of a diff. Refers to the text of a GapBuffer, Text, snapshot or plain string in place, segment by segment, so nothing is copied
+/// up front. Text & snapshots bring their line index along, which saves the diff from scanning for line breaks. A buffer with compressed chunks
+/// (see ColdStorage) is pinned for as long as the input lives, so the chunks it refers to all stay decompressed until then
+class DiffInput {
+public:
+    DiffInput(const GapBuffer &buffer);
+    DiffInput(const Text &text);
+    DiffInput(const SnapshotView &snapshot);
+    DiffInput(std::string_view text);
+
+    int size() const { return total_size; }
+    /// Calls fn(std::span<const char>) for each contiguous run of text in [begin, end)
+    template<typename Fn>
+    void for_each_segment(int begin, int end, Fn fn) const {
+        auto offset = 0;
+        for (auto segment : segments) {
+            const auto seg_size = static_cast<int>(segment.size());
+            const auto b = std::max(begin, offset), e = std::min(end, offset + seg_size);
+            if (b < e) fn(segment.subspan(b - offset, e - b));
+            offset += seg_size;
+            if (offset >= end) return;
+        }
+    }
+    /// The contiguous runs of text, in order
+    std::span<const std::span<const char>> spans() const { return segments; }
+    /// Line starts, if the source keeps a line index, empty otherwise
+    std::span<const int> line_starts() const { return lines; }
+
+private:
+    std::vector<std::span<const char>> segments;
+    std::span<const int> lines;
+    int total_size{0};
+    GapBuffer::ColdPin pin;
+};
+
+/// Lines [old_line, old_line + old_count) of the old text were replaced by lines [new_line, new_line + new_count) of the new text.
+/// old_count == 0 means lines were added, new_count == 0 that lines were removed
+struct DiffHunk {
+    int old_line;
+    int old_count;
+    int new_line;
+    int new_count;
+};
+
+struct LineDiff {
+    std::vector<DiffHunk> hunks;
+    /// The same hunks, as edits that turn the old text into the new one when handed to apply_edits()
+    std::vector<TextEdit> edits;
+};
+
+/// Line based Myers diff. The common prefix & suffix are skipped with vectorized compares across the segments of both sides, only the lines
+/// in between are hashed & diffed. If the middle differs in more than max_edit_distance lines, it is reported as one hunk instead
+LineDiff diff_lines(const DiffInput &old_text, const DiffInput &new_text, int max_edit_distance = 4096);
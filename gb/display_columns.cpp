@@ -0,0 +1,201 @@
+//
+// Created by 46769 on 2021-02-17.
+//
+
+#include "display_columns.hpp"
+#include "gap_buffer.hpp"
+#include "line_index.hpp"
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <span>
+
+namespace {
+    struct Range {
+        std::uint32_t first;
+        std::uint32_t last;
+    };
+
+    constexpr std::array<Range, 12> ZeroWidth{{
+            {0x0300, 0x036F},
+            {0x0483, 0x0489},
+            {0x0591, 0x05BD},
+            {0x0610, 0x061A},
+            {0x064B, 0x065F},
+            {0x1AB0, 0x1AFF},
+            {0x1DC0, 0x1DFF},
+            {0x200B, 0x200F},
+            {0x20D0, 0x20FF},
+            {0xFE00, 0xFE0F},
+            {0xFE20, 0xFE2F},
+            {0xFEFF, 0xFEFF},
+    }};
+
+    constexpr std::array<Range, 13> Wide{{
+            {0x1100, 0x115F},
+            {0x2E80, 0x303E},
+            {0x3041, 0x33FF},
+            {0x3400, 0x4DBF},
+            {0x4E00, 0x9FFF},
+            {0xA000, 0xA4CF},
+            {0xAC00, 0xD7A3},
+            {0xF900, 0xFAFF},
+            {0xFE30, 0xFE4F},
+            {0xFF00, 0xFF60},
+            {0xFFE0, 0xFFE6},
+            {0x1F300, 0x1FAFF},
+            {0x20000, 0x3FFFD},
+    }};
+
+    bool in(std::uint32_t code_point, std::span<const Range> ranges) {
+        const auto it = std::upper_bound(ranges.begin(), ranges.end(), code_point, [](std::uint32_t cp, const Range &r) { return cp < r.first; });
+        return it != ranges.begin() && code_point <= (it - 1)->last;
+    }
+}// namespace
+
+int display_width(std::uint32_t code_point) {
+    if (code_point < 0x20 || (code_point >= 0x7F && code_point < 0xA0)) return 0;
+    if (code_point < 0x300) return 1;
+    if (in(code_point, ZeroWidth)) return 0;
+    return in(code_point, Wide) ? 2 : 1;
+}
+
+DisplayColumns::DisplayColumns(int tab_width, int checkpoint_interval, int max_cached_lines)
+    : tab(std::max(tab_width, 1)), interval(std::max(checkpoint_interval, 16)), max_lines(std::max(max_cached_lines, 1)) {}
+
+void DisplayColumns::set_tab_width(int width) {
+    tab = std::max(width, 1);
+    cache.clear();
+}
+
+int DisplayColumns::tab_width() const {
+    return tab;
+}
+
+void DisplayColumns::clear() {
+    cache.clear();
+}
+
+template<typename Fn>
+int DisplayColumns::walk(const GapBuffer &buffer, int begin, int end, int column, Fn fn) const {
+    // UTF-8 is decoded across segment boundaries; a malformed sequence counts as one column per byte
+    std::uint32_t code_point = 0;
+    auto needed = 0, start = begin, pos = begin;
+    auto stopped = false;
+    const auto emit = [&](int char_start, int width) {
+        if (!fn(char_start, column, width)) return false;
+        column += width;
+        return true;
+    };
+    buffer.for_each_segment(begin, end, [&](std::span<const char> segment) {
+        for (const auto byte : segment) {
+            const auto ch = static_cast<unsigned char>(byte);
+            if (needed > 0 && (ch & 0xC0) == 0x80) {
+                code_point = (code_point << 6) | (ch & 0x3F);
+                pos++;
+                if (--needed == 0 && !emit(start, display_width(code_point))) return !(stopped = true);
+                continue;
+            }
+            if (needed > 0) {
+                needed = 0;
+                if (!emit(start, 1)) return !(stopped = true);
+            }
+            start = pos++;
+            if (ch < 0x80) {
+                const auto width = ch == '\t' ? tab - column % tab : display_width(ch);
+                if (!emit(start, width)) return !(stopped = true);
+            } else if (ch >= 0xC2 && ch <= 0xF4) {
+                needed = ch >= 0xF0 ? 3 : ch >= 0xE0 ? 2 : 1;
+                code_point = ch & (0x3F >> needed);
+            } else if (!emit(start, 1)) {
+                return !(stopped = true);
+            }
+        }
+        return true;
+    });
+    if (needed > 0 && !stopped) emit(start, 1);
+    return column;
+}
+
+int DisplayColumns::line_end(const GapBuffer &buffer, const LineIndex &lines, int line) {
+    return line + 1 < lines.line_count() ? lines.line_start(line + 1) - 1 : buffer.size();
+}
+
+DisplayColumns::LineColumns &DisplayColumns::line_columns(const LineIndex &lines, int line) {
+    auto it = cache.find(line);
+    if (it == cache.end()) {
+        if (static_cast<int>(cache.size()) >= max_lines) {
+            cache.erase(std::min_element(cache.begin(), cache.end(), [](const auto &a, const auto &b) { return a.second.last_use < b.second.last_use; }));
+        }
+        it = cache.emplace(line, LineColumns{lines.line_start(line), {{0, 0}}, 0, 0}).first;
+    }
+    it->second.last_use = ++use_counter;
+    return it->second;
+}
+
+void DisplayColumns::extend(const GapBuffer &buffer, LineColumns &entry, int end, int until, int column_limit) {
+    const auto &last = entry.checkpoints.back();
+    const auto begin = entry.line_start + std::max(last.offset, entry.walked);
+    if (begin >= end || entry.walked >= until || last.column > column_limit) return;
+    // resume from the last checkpoint, which is at a character boundary
+    const auto from = entry.line_start + last.offset;
+    auto reached = end;
+    walk(buffer, from, end, last.column, [&](int pos, int column, int) {
+        const auto offset = pos - entry.line_start;
+        if (offset >= entry.checkpoints.back().offset + interval) entry.checkpoints.push_back({offset, column});
+        if (offset >= until || column > column_limit) {
+            reached = pos;
+            return false;
+        }
+        return true;
+    });
+    entry.walked = std::max(entry.walked, reached - entry.line_start);
+}
+
+int DisplayColumns::column_of(const GapBuffer &buffer, const LineIndex &lines, int pos) {
+    const auto line = lines.line_of(pos);
+    auto &entry = line_columns(lines, line);
+    const auto offset = pos - entry.line_start;
+    extend(buffer, entry, line_end(buffer, lines, line), offset, INT_MAX);
+    const auto checkpoint = *(std::upper_bound(entry.checkpoints.begin(), entry.checkpoints.end(), offset, [](int o, const Checkpoint &c) { return o < c.offset; }) - 1);
+    return walk(buffer, entry.line_start + checkpoint.offset, pos, checkpoint.column, [](int, int, int) { return true; });
+}
+
+int DisplayColumns::position_of(const GapBuffer &buffer, const LineIndex &lines, int line, int column) {
+    auto &entry = line_columns(lines, line);
+    const auto end = line_end(buffer, lines, line);
+    extend(buffer, entry, end, INT_MAX, column);
+    const auto checkpoint = *(std::upper_bound(entry.checkpoints.begin(), entry.checkpoints.end(), column, [](int c, const Checkpoint &cp) { return c < cp.column; }) - 1);
+    auto result = end;
+    walk(buffer, entry.line_start + checkpoint.offset, end, checkpoint.column, [&](int pos, int at, int width) {
+        if (at + width <= column) return true;
+        result = pos;
+        return false;
+    });
+    return result;
+}
+
+void DisplayColumns::on_change(const ChangeEvent &event, const LineIndex &lines) {
+    if (cache.empty()) return;
+    // the text before the edit is untouched, so the line it starts on has the same number & start as before
+    const auto first_line = lines.line_of(event.offset);
+    const auto erased_end = event.offset + event.removed;
+    std::map<int, LineColumns> updated;
+    for (auto &[line, entry] : cache) {
+        if (line < first_line) {
+            updated.emplace(line, std::move(entry));
+        } else if (line == first_line) {
+            // checkpoints up to the edit only depend on the text before it, and are still right
+            const auto edit_offset = event.offset - entry.line_start;
+            std::erase_if(entry.checkpoints, [edit_offset](const Checkpoint &c) { return c.offset > edit_offset; });
+            entry.walked = std::min(entry.walked, entry.checkpoints.back().offset);
+            updated.emplace(line, std::move(entry));
+        } else if (entry.line_start > erased_end) {
+            // a line after the edit: same contents, moved
+            entry.line_start += event.inserted - event.removed;
+            updated.emplace(line + event.line_delta, std::move(entry));
+        }
+        // anything else began inside the erased text, & is gone or merged into first_line
+    }
+    cache = std::move(updated);
+}
@@ -0,0 +1,65 @@
+//
+// Created by 46769 on 2021-02-17.
+//
+
+#pragma once
+#include "changes.hpp"
+#include <cstdint>
+#include <map>
+#include <vector>
+
+class GapBuffer;
+class LineIndex;
+
+/// Returns how many columns a code point takes up on screen: 2 for East Asian wide & fullwidth characters and emoji, 0 for combining marks,
+/// zero width characters & control characters, 1 for everything else. Tabs are handled by DisplayColumns, as they depend on the column
+int display_width(std::uint32_t code_point);
+
+/// Maps text positions to display columns & back, with tabs expanded to the next multiple of tab_width & wide characters counted double.
+/// Walking a line from its start on every lookup is quadratic on long (minified) lines, so each line that has been looked at keeps a checkpoint
+/// {offset, column} every checkpoint_interval bytes, & a lookup only walks from the nearest checkpoint. Edits truncate the checkpoints of the
+/// line they're on from the edit onwards, drop the ones of lines they erased, and leave the lines after them alone.
+/// Only the most recently used lines are kept, so the cache stays small however large the text is
+class DisplayColumns {
+public:
+    explicit DisplayColumns(int tab_width = 4, int checkpoint_interval = 4096, int max_cached_lines = 256);
+
+    void set_tab_width(int width);
+    int tab_width() const;
+    /// Returns the display column that text position pos begins at
+    int column_of(const GapBuffer &buffer, const LineIndex &lines, int pos);
+    /// Returns the text position of the character on line that covers display column column. Columns past the end of the line map to the end of the line
+    int position_of(const GapBuffer &buffer, const LineIndex &lines, int line, int column);
+    /// Updates the cache after an edit. lines must already include the edit
+    void on_change(const ChangeEvent &event, const LineIndex &lines);
+    void clear();
+
+private:
+    struct Checkpoint {
+        /// Offset from the line start, always at the start of a character
+        int offset;
+        int column;
+    };
+    struct LineColumns {
+        int line_start;
+        std::vector<Checkpoint> checkpoints;
+        /// The offset up to which checkpoints have been placed; the line has been walked up to here
+        int walked;
+        std::uint64_t last_use;
+    };
+
+    LineColumns &line_columns(const LineIndex &lines, int line);
+    /// Returns the end of line, excluding its line break
+    static int line_end(const GapBuffer &buffer, const LineIndex &lines, int line);
+    /// Walks the line from its last checkpoint on, until offset until or the column reaches column_limit, placing checkpoints on the way
+    void extend(const GapBuffer &buffer, LineColumns &entry, int end, int until, int column_limit);
+    /// Walks text positions [begin, end) from column, calling fn(pos, column, width) for each character; fn returns false to stop. Returns the column after
+    template<typename Fn>
+    int walk(const GapBuffer &buffer, int begin, int end, int column, Fn fn) const;
+
+    int tab;
+    int interval;
+    int max_lines;
+    std::uint64_t use_counter{0};
+    std::map<int, LineColumns> cache;
+};
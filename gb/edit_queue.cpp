@@ -0,0 +1,53 @@
+//
+// Created by 46769 on 2021-02-14.
+//
+
+#include "edit_queue.hpp"
+#include "text.hpp"
+
+EditQueue::EditQueue() : head(new Node{}) {
+    tail.store(head, std::memory_order_relaxed);
+}
+
+EditQueue::~EditQueue() {
+    while (head != nullptr) {
+        auto next = head->next.load(std::memory_order_relaxed);
+        delete head;
+        head = next;
+    }
+}
+
+void EditQueue::submit(std::uint64_t base_version, std::vector<TextEdit> edits) {
+    auto node = new Node{};
+    node->record = EditRecord{base_version, std::move(edits)};
+    const auto previous = tail.exchange(node, std::memory_order_acq_rel);
+    // between the exchange & this store the queue is momentarily cut at previous, the consumer then just sees fewer records
+    previous->next.store(node, std::memory_order_release);
+}
+
+std::uint64_t EditQueue::version() const {
+    return published_version.load(std::memory_order_acquire);
+}
+
+DrainResult EditQueue::drain(Text &text, int max_records, const std::function<void(EditRecord &&)> &on_rejected) {
+    DrainResult result;
+    text.begin_transaction();
+    while (result.applied + result.rejected < max_records) {
+        const auto next = head->next.load(std::memory_order_acquire);
+        if (next == nullptr) break;
+        delete head;
+        head = next;
+        auto &record = next->record;
+        if (record.base_version == text.version() && valid_edits(record.edits, text.size())) {
+            apply_edits(text, record.edits);
+            result.applied++;
+        } else {
+            result.rejected++;
+            if (on_rejected) on_rejected(std::move(record));
+        }
+        record.edits.clear();
+    }
+    text.end_transaction();
+    published_version.store(text.version(), std::memory_order_release);
+    return result;
+}
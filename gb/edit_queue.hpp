@@ -0,0 +1,57 @@
+//
+// Created by 46769 on 2021-02-14.
+//
+
+#pragma once
+#include "text_edit.hpp"
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class Text;
+
+/// A batch of edits made against the text as it was at base_version (see Text::version())
+struct EditRecord {
+    std::uint64_t base_version;
+    std::vector<TextEdit> edits;
+};
+
+struct DrainResult {
+    int applied{0};
+    int rejected{0};
+};
+
+/// Lets other threads (language servers, formatters, plugins) hand edits to the thread that owns a Text, without a lock around the Text.
+/// Producers push records onto an intrusive MPSC queue (Vyukov's), which costs them one atomic exchange and never waits on anyone;
+/// the owning thread drains the queue when it is safe to edit, so editor input never contends with background producers
+class EditQueue {
+public:
+    EditQueue();
+    EditQueue(const EditQueue &) = delete;
+    EditQueue &operator=(const EditQueue &) = delete;
+    ~EditQueue();
+
+    /// Thread safe. Queues edits made against base_version
+    void submit(std::uint64_t base_version, std::vector<TextEdit> edits);
+    /// Thread safe. The version of the Text as of the owner's last drain(), for producers to base their edits on
+    std::uint64_t version() const;
+
+    /// Owning thread only. Applies up to max_records queued records in submission order, as one transaction. A record whose base version
+    /// isn't the Text's current version is stale, its offsets may no longer mean what the producer meant, so it's handed to on_rejected
+    /// instead, for the producer to redo against the new text. So is a record whose edits apply_edits can't take (see valid_edits), i.e. that
+    /// reach past the end of the text, or aren't sorted & non-overlapping
+    DrainResult drain(Text &text, int max_records = INT_MAX, const std::function<void(EditRecord &&)> &on_rejected = {});
+
+private:
+    struct Node {
+        std::atomic<Node *> next{nullptr};
+        EditRecord record;
+    };
+
+    /// Producers swap themselves in at the tail, the consumer pops at head. head is always a node that was already consumed (or the initial stub)
+    std::atomic<Node *> tail;
+    Node *head;
+    std::atomic<std::uint64_t> published_version{0};
+};
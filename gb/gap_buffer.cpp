@@ -3,31 +3,120 @@
 //
 
 #include "gap_buffer.hpp"
+#include "lz4.hpp"
+#include "memory.hpp"
+#include "search.hpp"
 #include "text.hpp"
 #include <ranges>
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <functional>
+#include <utility>
 
-GapBuffer::GapBuffer(int starting_capacity, int gap_size) : state{.gap = {0, gap_size}, .cursor = {}, .size = 0, .cap = starting_capacity, .gap_starting_size = gap_size}, data(nullptr) {
-    data = new char[starting_capacity];
+GapBuffer::GapBuffer(int starting_capacity, int gap_size) : state{.gap = {0, std::min(gap_size, starting_capacity)}, .cursor = {}, .size = 0, .cap = starting_capacity, .gap_starting_size = gap_size}, data(nullptr) {
+    data = allocate_storage(starting_capacity, mapped);
     state.cursor.gap_pos = &state.gap.begin;
 }
 
+GapBuffer::GapBuffer(GapBuffer &&other) noexcept : state{other.state.gap, other.state.cursor, other.state.size, other.state.cap, other.state.gap_starting_size}, data(other.data), mapped(other.mapped),
+                                                  pending(std::move(other.pending)), coalescing(other.coalescing), policy(other.policy), released_free_space(other.released_free_space),
+                                                  cold_settings(other.cold_settings), cold_chunks(std::move(other.cold_chunks)), cold_cache(std::move(other.cold_cache)) {
+    state.cursor.gap_pos = &state.gap.begin;
+    other.data = nullptr;
+    other.state.cap = 0;
+    other.state.reset();
+}
+
+GapBuffer::GapBuffer(const GapBuffer &other) : state{{other.size(), 0}, other.state.cursor, other.size(), std::max(other.state.cap, other.size() + other.state.gap_starting_size), other.state.gap_starting_size},
+                                                data(nullptr), coalescing(other.coalescing), policy(other.policy), cold_settings(other.cold_settings) {
+    state.gap.length = state.cap - state.size;
+    state.cursor.gap_pos = &state.gap.begin;
+    data = allocate_storage(state.cap, mapped);
+    // read through other's segments, which takes care of its staged edits & compressed chunks
+    auto offset = 0;
+    other.for_each_segment(0, other.size(), [&](std::span<const char> segment) {
+        std::memcpy(data + offset, segment.data(), segment.size());
+        offset += static_cast<int>(segment.size());
+    });
+}
+
+GapBuffer::GapBuffer(const GapBuffer &other, const std::shared_ptr<const ForkBase> &base)
+    : state{other.state.gap, other.state.cursor, other.state.size, other.state.cap, other.state.gap_starting_size}, data(nullptr), coalescing(other.coalescing),
+      policy(other.policy), cold_settings(other.cold_settings), cold_chunks(other.cold_chunks) {
+    state.cursor.gap_pos = &state.gap.begin;
+    data = allocate_storage(state.cap, mapped);
+    share_chunks(base);
+}
+
+GapBuffer::~GapBuffer() {
+    free_storage(data, state.cap, mapped);
+}
+
 int GapBuffer::pos() const {
     GAP_BUFFER_ASSERT(*state.cursor.gap_pos == state.gap.begin);
-    return state.gap.begin;
+    return state.cursor.pos;
 }
 
 int GapBuffer::line() const {
     return state.cursor.line;
 }
 
-[[maybe_unused]] int GapBuffer::col_pos() const {
+int GapBuffer::col_pos() const {
     return state.cursor.col;
 }
 
+BufferCursor GapBuffer::cursor_moved_to(int index) const {
+    auto cursor = state.cursor;
+    if (index >= cursor.pos) {
+        auto last_break = -1, offset = cursor.pos;
+        for_each_segment(cursor.pos, index, [&](std::span<const char> segment) {
+            if (const auto breaks = static_cast<int>(std::ranges::count(segment, '\n')); breaks > 0) {
+                cursor.line += breaks;
+                last_break = offset + static_cast<int>(std::find(segment.rbegin(), segment.rend(), '\n').base() - segment.begin()) - 1;
+            }
+            offset += static_cast<int>(segment.size());
+        });
+        cursor.col = last_break < 0 ? cursor.col + (index - cursor.pos) : index - last_break - 1;
+    } else {
+        const auto breaks = count_line_breaks(index, cursor.pos);
+        cursor.line -= breaks;
+        cursor.col = breaks == 0 ? cursor.col - (cursor.pos - index) : index - line_start_before(index);
+    }
+    cursor.pos = index;
+    return cursor;
+}
+
+void GapBuffer::advance_cursor(std::string_view text) {
+    const auto length = static_cast<int>(text.size());
+    const auto breaks = static_cast<int>(std::ranges::count(text, '\n'));
+    state.cursor.line += breaks;
+    state.cursor.col = breaks == 0 ? state.cursor.col + length : length - static_cast<int>(text.rfind('\n')) - 1;
+    state.cursor.pos += length;
+}
+
+int GapBuffer::count_line_breaks(int begin, int end) const {
+    auto breaks = 0;
+    for_each_segment(begin, end, [&breaks](std::span<const char> segment) { breaks += static_cast<int>(std::ranges::count(segment, '\n')); });
+    return breaks;
+}
+
+int GapBuffer::line_start_before(int pos) const {
+    // looks back through growing windows, so that a short line costs a short scan
+    for (auto end = pos, window = 256; end > 0; window *= 2) {
+        const auto begin = std::max(end - window, 0);
+        auto start = -1, offset = begin;
+        for_each_segment(begin, end, [&](std::span<const char> segment) {
+            if (const auto it = std::find(segment.rbegin(), segment.rend(), '\n'); it != segment.rend()) start = offset + static_cast<int>(it.base() - segment.begin());
+            offset += static_cast<int>(segment.size());
+        });
+        if (start >= 0) return start;
+        end = begin;
+    }
+    return 0;
+}
+
 char GapBuffer::get_ch() const {
     if(state.cursor.pos == size()) return 0;
     return get_at(state.cursor.pos);
@@ -40,51 +129,44 @@ int GapBuffer::gap_length() const {
 
 
 void GapBuffer::insert_str(std::string_view v) {
+    if (stage_insert(v)) return;
     gap_commit();
     const auto insertSize = v.size();
-    auto cap = capacity();
-    if (insertSize + size() >= cap) {
-        resize_buffer_capacity((insertSize + cap) * 2);
-    }
+    ensure_capacity(size() + insertSize);
     if (insertSize < gap_length()) {
         std::memcpy(data + state.gap.begin, v.data(), insertSize);
         state.gap.begin += insertSize;
         state.gap.length -= insertSize;
         state.size += insertSize;
-        state.cursor.pos += insertSize;
+        advance_cursor(v);
     } else {
         for (auto c : v) insert(c);
     }
 }
 
 void GapBuffer::insert(char ch) {
+    if (stage_insert({&ch, 1})) return;
     gap_commit();
-    if (size() == capacity()) {
-        resize_buffer_capacity(capacity() * 2);
-    }
+    ensure_capacity(size() + 1);
     if (state.gap.length == 0) {
         resize_gap(state.gap_starting_size);
     }
     data[state.gap.begin] = ch;
-    if (ch == '\n') {
-        state.cursor.line++;
-        state.cursor.col = 0;
-    }
-    state.cursor.pos++;
+    advance_cursor({&ch, 1});
     state.gap.begin++;
     state.gap.length--;
     state.size++;
 }
 
 void GapBuffer::resize_gap(int gap_size) {
-    if (size() + gap_size >= capacity()) {
-        resize_buffer_capacity((capacity() + gap_size) * 2);
-    }
-    GAP_BUFFER_ASSERT(size() + gap_size < capacity());
+    ensure_capacity(size() + gap_size);
+    if (state.gap.length >= gap_size) return;
+    GAP_BUFFER_ASSERT(size() + gap_size < capacity() && gap_size >= state.gap.length);
 
-    auto elements_to_shift = size() - (state.gap.begin + state.gap.length);
+    auto elements_to_shift = size() - state.gap.begin;
+    thaw(state.gap.begin + state.gap.length, state.gap.begin + state.gap.length + elements_to_shift);
     auto begin = data + (state.gap.begin + state.gap.length);
-    auto gap_end = begin + gap_size;
+    auto gap_end = data + (state.gap.begin + gap_size);
     /// dst / src are overlapping, memmove must be used, memcpy is UB
     std::memmove(gap_end, begin, elements_to_shift);
     state.gap.length = gap_size;
@@ -99,13 +181,10 @@ void GapBuffer::move_gap_cursor_to(int index) {
     if (index == state.gap.begin) return;
     GAP_BUFFER_ASSERT(index != state.gap.begin && index <= size() && index >= 0);// this assert is to see that we don't do dumb "move to where we are"
     index = std::max(0, index);
-    if (index > state.gap.begin + state.gap.length) {
-        auto items_to_move = index - (state.gap.begin + gap_length());
-        auto begin = data + state.gap.begin;
-        auto e = begin + state.gap.length;
-        std::memmove(begin, e, items_to_move);
-        state.gap.begin = index;
-    } else if (index > state.gap.begin && index <= (state.gap.begin + state.gap.length)) {
+    // the text between the old & new gap position is moved across the gap
+    thaw(std::min(index, state.gap.begin), std::max(index, state.gap.begin) + state.gap.length);
+    if (index > state.gap.begin) {
+        // text positions are gap-less, so moving the gap forward always shifts exactly (index - gap.begin) elements, regardless of gap length
         auto items_to_move = index - state.gap.begin;
         auto begin = data + state.gap.begin;
         auto e = begin + state.gap.length;
@@ -127,31 +206,120 @@ int GapBuffer::capacity() const {
 
 void GapBuffer::resize_buffer_capacity(int new_size) {
     GAP_BUFFER_ASSERT(new_size > size());
-    auto heap = new char[new_size];
-    if (size() == 0) {
-        delete data;
-        data = heap;
+    released_free_space = 0;
+    thaw_all();
+    // A mapped buffer that stays large enough to be mapped, is resized without copying (where the platform can)
+    if (mapped && new_size >= policy.mmap_threshold && remap_storage(new_size)) return;
+
+    bool new_mapped = false;
+    auto storage = allocate_storage(new_size, new_mapped);
+    // Only the text is copied, not the gap or whatever lies past the text. The gap takes up all of the free space in the new allocation
+    const auto after_gap = size() - state.gap.begin;
+    const auto new_gap_length = new_size - size();
+    std::memcpy(storage, data, state.gap.begin);
+    std::memcpy(storage + state.gap.begin + new_gap_length, data + state.gap.begin + state.gap.length, after_gap);
+    free_storage(data, state.cap, mapped);
+    data = storage;
+    mapped = new_mapped;
+    state.cap = new_size;
+    state.gap.length = new_gap_length;
+}
+
+bool GapBuffer::remap_storage(int new_size) {
+    const auto after_gap = size() - state.gap.begin;
+    const auto new_gap_length = new_size - size();
+    const auto old_after_gap_begin = state.gap.begin + state.gap.length;
+    const auto new_after_gap_begin = state.gap.begin + new_gap_length;
+    if (new_size < capacity()) {
+        // shrinking: the text after the gap has to be moved down, before the pages it lives in are dropped
+        std::memmove(data + new_after_gap_begin, data + old_after_gap_begin, after_gap);
+        auto storage = vmem::remap(data, capacity(), new_size, policy.huge_pages);
+        if (storage == nullptr) {
+            std::memmove(data + old_after_gap_begin, data + new_after_gap_begin, after_gap);
+            return false;
+        }
+        data = storage;
     } else {
-        // For now, our intrinsics version does the exact same thing for correctness measures
-        /// TODO(sse/avx): copy larger sections using SIMD instructions. Can speed up by a lot
-#ifdef INTRINSICS
-        std::memcpy(heap, data, capacity());
-#else
-        std::memcpy(heap, data, capacity());
-#endif
-        auto foo = data;
-        data = heap;
-        delete foo;
-        state.cap = new_size;
+        auto storage = vmem::remap(data, capacity(), new_size, policy.huge_pages);
+        if (storage == nullptr) return false;
+        data = storage;
+        std::memmove(data + new_after_gap_begin, data + old_after_gap_begin, after_gap);
+    }
+    state.cap = new_size;
+    state.gap.length = new_gap_length;
+    return true;
+}
+
+char *GapBuffer::allocate_storage(int capacity, bool &is_mapped) const {
+    if (capacity >= policy.mmap_threshold && vmem::can_map()) {
+        if (auto storage = vmem::map(capacity, policy.huge_pages); storage != nullptr) {
+            is_mapped = true;
+            return storage;
+        }
+    }
+    is_mapped = false;
+    return new char[capacity];
+}
+
+void GapBuffer::free_storage(char *storage, int capacity, bool is_mapped) {
+    if (is_mapped) {
+        vmem::unmap(storage, capacity);
+    } else {
+        delete[] storage;
+    }
+}
+
+void GapBuffer::ensure_capacity(int required_size) {
+    if (required_size < capacity()) return;
+    const auto grown = static_cast<long long>(capacity() * policy.growth_factor);
+    const auto bounded = std::min<long long>(grown, static_cast<long long>(required_size) + policy.max_gap_size);
+    const auto new_capacity = std::max<long long>(bounded, static_cast<long long>(required_size) + state.gap_starting_size);
+    resize_buffer_capacity(static_cast<int>(new_capacity));
+}
+
+void GapBuffer::apply_shrink_policy() {
+    // size() includes staged edits, which aren't in the storage yet
+    if (!pending.empty()) return;
+    if (capacity() > policy.min_capacity && size() < capacity() * policy.shrink_threshold) {
+        const auto target = std::min<long long>(static_cast<long long>(size() / policy.shrink_target), static_cast<long long>(size()) + policy.max_gap_size);
+        const auto new_capacity = std::max<long long>({target, policy.min_capacity, static_cast<long long>(size()) + state.gap_starting_size});
+        if (new_capacity < capacity()) {
+            resize_buffer_capacity(static_cast<int>(new_capacity));
+            return;
+        }
+    }
+    // Not worth a reallocation, but a gap this large shouldn't stay resident either
+    const auto free_space = capacity() - size();
+    if (!mapped) {
+        // the pages of a heap allocation belong to the allocator, so instead of handing them back, the buffer is reallocated. Only once the free
+        // space also outgrows the text, which keeps the copying to at most 2 bytes per byte erased
+        const auto slack = std::max(policy.release_threshold, size());
+        if (free_space >= slack) {
+            const auto new_capacity = std::max<long long>({static_cast<long long>(size()) + slack / 2, policy.min_capacity, static_cast<long long>(size()) + state.gap_starting_size});
+            if (new_capacity < capacity()) resize_buffer_capacity(static_cast<int>(new_capacity));
+        }
+        return;
+    }
+    if (free_space < policy.release_threshold) {
+        released_free_space = std::min(released_free_space, free_space);
+    } else if (free_space - released_free_space >= policy.release_threshold) {
+        const auto gap_begin = data + state.gap.begin;
+        const auto text_end = data + size() + state.gap.length;
+        vmem::release_pages(gap_begin, gap_begin + state.gap.length);
+        vmem::release_pages(text_end, data + capacity());
+        released_free_space = free_space;
     }
 }
 
 void GapBuffer::erase_forward(int char_count) {
+    const auto count = std::clamp(char_count, 0, size() - state.cursor.pos);
+    if (count > 0 && stage_erase(state.cursor.pos, state.cursor.pos + count)) return;
     gap_commit();
-    if (state.gap.begin < size()) {
-        // TODO: update meta data for remaining lines in buffer, once meta data exists for this buffer type
-        state.gap.length++;
-        state.size--;
+    if (count > 0) {
+        thaw(state.gap.begin + state.gap.length, state.gap.begin + state.gap.length + count);
+        state.gap.length += count;
+        state.size -= count;
+        apply_shrink_policy();
     }
 }
 int GapBuffer::remaining_space() const {
@@ -159,19 +327,74 @@ int GapBuffer::remaining_space() const {
 }
 
 void GapBuffer::erase_backward(int char_count) {
+    const auto erase_begin = std::max(state.cursor.pos - char_count, 0);
+    // counted while the erased text is still there
+    const auto cursor = cursor_moved_to(erase_begin);
+    if (erase_begin < state.cursor.pos && stage_erase(erase_begin, state.cursor.pos)) {
+        state.cursor = cursor;
+        return;
+    }
     gap_commit();
+    thaw(std::max(state.gap.begin - char_count, 0), state.gap.begin);
     if ((state.gap.begin - char_count) > 0) {
-        state.cursor.pos -= char_count;
         state.gap.begin -= char_count;
         state.gap.length += char_count;
         state.size -= char_count;
     } else {
         auto diff = state.gap.begin;
-        state.cursor.pos = 0;
         state.gap.begin = 0;
         state.gap.length += diff;
         state.size -= diff;
     }
+    state.cursor = cursor;
+    apply_shrink_policy();
+}
+
+void GapBuffer::replace(int pos, int length, std::string_view text) {
+    GAP_BUFFER_ASSERT(pos >= 0 && pos <= size());
+    pos = std::clamp(pos, 0, size());
+    length = std::clamp(length, 0, size() - pos);
+    const auto inserted = static_cast<int>(text.size());
+    if (length == 0 && inserted == 0) return;
+    fold_pending();
+    const auto end = pos + length;
+    // a line break between the edit & the cursor leaves the cursor's column as it is. Otherwise the cursor's line & column are counted to
+    // the edit while the erased text is still there, & from there over the inserted text
+    const auto cursor = state.cursor;
+    const auto moves = cursor.pos >= end || cursor.pos > pos;
+    const auto shielded = cursor.pos >= end && cursor.col < cursor.pos - end;
+    const auto erased_breaks = shielded ? count_line_breaks(pos, end) : 0;
+    const auto at_edit = moves && !shielded ? cursor_moved_to(pos) : cursor;
+    if (state.gap.begin < pos) {
+        move_gap_cursor_to(pos);
+    } else if (state.gap.begin > end) {
+        move_gap_cursor_to(end);
+    }
+    // the erased text either side of the gap becomes part of it
+    const auto after_gap = end - state.gap.begin;
+    thaw(pos, state.gap.begin);
+    thaw(state.gap.begin + state.gap.length, state.gap.begin + state.gap.length + after_gap);
+    state.gap.begin = pos;
+    state.gap.length += length;
+    state.size -= length;
+    if (inserted > 0) write_at_gap(text);
+
+    if (shielded) {
+        state.cursor.pos += inserted - length;
+        state.cursor.line += static_cast<int>(std::ranges::count(text, '\n')) - erased_breaks;
+    } else if (moves) {
+        // a cursor inside the replaced text ends up after the new text, one after it stays on the same line, after the same characters
+        const auto after = std::max(cursor.pos - end, 0);
+        state.cursor = at_edit;
+        advance_cursor(text);
+        state.cursor.pos += after;
+        state.cursor.col += after;
+    }
+    if (inserted < length) apply_shrink_policy();
+}
+
+void GapBuffer::erase_range(int pos, int length) {
+    replace(pos, length, {});
 }
 
 void GapBuffer::move_gap_cursor_back(int steps) {
@@ -181,95 +404,285 @@ void GapBuffer::move_gap_cursor_forward(int steps) {
     move_gap_cursor_to(state.gap.begin + steps);
 }
 void GapBuffer::clear() {
+    pending.clear();
+    cold_chunks.clear();
+    cold_cache.clear();
     state.reset();
+    apply_shrink_policy();
 }
 
-std::optional<int> GapBuffer::find(std::string_view search) {
-    auto begin = data;
-    auto e = data + gap_begin();
-    auto it = std::search(begin, e, std::boyer_moore_searcher(search.begin(), search.end()));
-    if (it != e) {
-        return std::distance(begin, it);
+void GapBuffer::shrink_to_fit() {
+    fold_pending();
+    const auto new_capacity = size() + state.gap_starting_size;
+    if (new_capacity < capacity()) resize_buffer_capacity(new_capacity);
+}
+
+void GapBuffer::assign(std::string_view text, int gap_position, int gap_length) {
+    GAP_BUFFER_ASSERT(gap_position >= 0 && gap_position <= static_cast<int>(text.size()));
+    const auto length = static_cast<int>(text.size());
+    pending.clear();
+    cold_chunks.clear();
+    cold_cache.clear();
+    state.reset();
+    // the buffer is empty at this point, so growing it copies nothing
+    ensure_capacity(length + std::max(gap_length, state.gap_starting_size));
+    state.gap.begin = gap_position;
+    state.gap.length = capacity() - length;
+    std::memcpy(data, text.data(), gap_position);
+    std::memcpy(data + gap_position + state.gap.length, text.data() + gap_position, length - gap_position);
+    state.size = length;
+}
+
+char *GapBuffer::prepare_append(int length) {
+    fold_pending();
+    move_gap_cursor_to(size());
+    ensure_capacity(size() + length);
+    return data + state.gap.begin;
+}
+
+void GapBuffer::commit_append(int length) {
+    GAP_BUFFER_ASSERT(state.gap.begin == size() && length <= state.gap.length);
+    state.gap.begin += length;
+    state.gap.length -= length;
+    state.size += length;
+}
+
+void GapBuffer::set_growth_policy(GrowthPolicy growth_policy) {
+    policy = growth_policy;
+    released_free_space = 0;
+    apply_shrink_policy();
+}
+
+const GrowthPolicy &GapBuffer::growth_policy() const {
+    return policy;
+}
+
+void GapBuffer::set_cold_storage(ColdStorage settings) {
+    thaw_all();
+    const auto page = static_cast<int>(vmem::page_size());
+    settings.chunk_size = std::max(page, (settings.chunk_size + page - 1) / page * page);
+    // the chunk being read must not be evicted by reading the next one
+    settings.cache_chunks = std::max(settings.cache_chunks, 2);
+    cold_settings = settings;
+}
+
+const ColdStorage &GapBuffer::cold_storage() const {
+    return cold_settings;
+}
+
+int GapBuffer::compress_cold_chunks() {
+    if (!cold_settings.enabled || !mapped) return 0;
+    fold_pending();
+    const auto chunk_size = cold_chunk_size();
+    const auto text_end = static_cast<long long>(size()) + state.gap.length;
+    const auto hot_begin = static_cast<long long>(state.gap.begin) - cold_settings.gap_distance;
+    const auto hot_end = static_cast<long long>(state.gap.begin) + state.gap.length + cold_settings.gap_distance;
+    auto compressed = 0;
+    std::vector<char> out;
+    for (auto chunk = 0; static_cast<long long>(chunk + 1) * chunk_size <= text_end; chunk++) {
+        const auto begin = static_cast<long long>(chunk) * chunk_size;
+        if ((begin + chunk_size > hot_begin && begin < hot_end) || cold_chunks.contains(chunk)) continue;
+        lz4::compress({data + begin, static_cast<std::size_t>(chunk_size)}, out);
+        // text that doesn't compress to at most 3/4 isn't worth the decompression on every read
+        if (out.size() > static_cast<std::size_t>(chunk_size) / 4 * 3) continue;
+        cold_chunks.emplace(chunk, ColdChunk{{out.begin(), out.end()}, false});
+        vmem::release_pages(data + begin, data + begin + chunk_size);
+        compressed++;
     }
-    // c++ implicit conversions suck. The compiler *should* be able to figure out, that the first param (gap_begin()) is int
-    // the second param search.size() is size_t, so how does it go on? Well, the compiler also sees that I am asking for >=0,
-    // which is *literally* always true for size_t, yet no warning, no message, nothing. But that's not even the point,
-    // I am *explicitly* asking for >=0 in hardcoded literal. It is always true if it decides to cast the expression to size_t, it doesn't make sense.
-    if (gap_begin() - (int) search.size() >= 0) {
-        auto searchSize = search.size();
-        // Scan across gap boundary naively/brute force
-        for (auto i = gap_begin() - searchSize; i < gap_begin() + searchSize; i++) {
-            auto matches = false;
-            for (auto inner = 0; inner < searchSize; inner++) {
-                auto ch = get_at(i + inner);
-                char needle_ch = search[inner];
-                if (ch != needle_ch) {
-                    matches = false;
-                    break;
-                } else {
-                    matches = true;
-                }
-            }
-            if (matches) {
-                return i;
-            }
+    return compressed;
+}
+
+int GapBuffer::cold_chunk_count() const {
+    return static_cast<int>(std::ranges::count_if(cold_chunks, [](const auto &entry) { return entry.second.base == nullptr; }));
+}
+
+std::size_t GapBuffer::cold_bytes() const {
+    std::size_t bytes = 0;
+    for (const auto &[chunk, cold] : cold_chunks) bytes += cold.compressed.size();
+    return bytes;
+}
+
+GapBuffer GapBuffer::fork() {
+    if (!mapped) return GapBuffer{*this};
+    fold_pending();
+    bool storage_mapped = false;
+    const auto storage = allocate_storage(state.cap, storage_mapped);
+    const auto base = std::make_shared<const ForkBase>(data, state.cap, mapped);
+    data = storage;
+    mapped = storage_mapped;
+    released_free_space = 0;
+    share_chunks(base);
+    return GapBuffer{*this, base};
+}
+
+void GapBuffer::share_chunks(const std::shared_ptr<const ForkBase> &base) {
+    cold_cache.clear();
+    const auto chunk_size = static_cast<long long>(cold_chunk_size());
+    const auto gap_end = static_cast<long long>(state.gap.begin) + state.gap.length;
+    const auto text_end = static_cast<long long>(size()) + state.gap.length;
+    for (auto chunk = 0; chunk * chunk_size < text_end; chunk++) {
+        const auto begin = chunk * chunk_size;
+        const auto end = std::min(begin + chunk_size, static_cast<long long>(state.cap));
+        if (const auto it = cold_chunks.find(chunk); it != cold_chunks.end()) {
+            // compressed chunks decompress from their own copy, and chunks shared with an earlier fork are still in that fork's base
+            it->second.resident = false;
+            continue;
         }
-        auto seg_begin = data + gap_begin() + gap_length();
-        auto seg_end = data + size() + gap_length();
-        auto iter = std::search(seg_begin, seg_end, std::boyer_moore_searcher(search.begin(), search.end()));
-        if (iter != seg_end) {
-            auto diff = std::distance(seg_begin, iter);
-            return diff + gap_begin();
+        if (begin >= state.gap.begin && end <= gap_end) continue;
+        if ((begin < gap_end && end > state.gap.begin) || end >= text_end) {
+            std::memcpy(data + begin, base->data + begin, end - begin);
+        } else {
+            cold_chunks.emplace(chunk, ColdChunk{{}, false, base});
         }
-    } else {// the cursor is in a position, where the needle size can not fit before it
-        auto searchSize = search.size();
-        for (auto i = 0; i < searchSize + gap_begin(); i++) {
-            auto matches = false;
-            for (auto inner = 0; inner < searchSize; inner++) {
-                auto ch = get_at(i + inner);
-                char needle_ch = search[inner];
-                if (ch != needle_ch) {
-                    matches = false;
-                    break;
-                } else {
-                    matches = true;
-                }
+    }
+}
+
+int GapBuffer::shared_chunk_count() const {
+    return static_cast<int>(std::ranges::count_if(cold_chunks, [](const auto &entry) { return entry.second.base != nullptr; }));
+}
+
+int GapBuffer::cold_chunk_size() const {
+    return cold_settings.chunk_size;
+}
+
+void GapBuffer::load_cold_chunk(int chunk) const {
+    const auto it = cold_chunks.find(chunk);
+    if (it == cold_chunks.end()) return;
+    if (it->second.base) {
+        // shared with a fork: copied over for good, as there's nothing to evict it to
+        const auto begin = static_cast<long long>(chunk) * cold_chunk_size();
+        const auto length = std::min<long long>(cold_chunk_size(), state.cap - begin);
+        std::memcpy(data + begin, it->second.base->data + begin, length);
+        cold_chunks.erase(it);
+        return;
+    }
+    if (it->second.resident) {
+        // already decompressed, just mark it as the most recently read
+        std::erase(cold_cache, chunk);
+        cold_cache.push_back(chunk);
+        return;
+    }
+    const auto chunk_size = cold_chunk_size();
+    const auto decompressed = lz4::decompress(it->second.compressed, {data + static_cast<long long>(chunk) * chunk_size, static_cast<std::size_t>(chunk_size)});
+    GAP_BUFFER_ASSERT(decompressed);
+    it->second.resident = true;
+    cold_cache.push_back(chunk);
+    trim_cold_cache();
+}
+
+void GapBuffer::trim_cold_cache() const {
+    if (cold_pins > 0) return;
+    const auto chunk_size = cold_chunk_size();
+    while (static_cast<int>(cold_cache.size()) > cold_settings.cache_chunks) {
+        const auto evicted = cold_cache.front();
+        cold_cache.erase(cold_cache.begin());
+        cold_chunks[evicted].resident = false;
+        const auto begin = data + static_cast<long long>(evicted) * chunk_size;
+        vmem::release_pages(begin, begin + chunk_size);
+    }
+}
+
+GapBuffer::ColdPin::ColdPin(const GapBuffer *buffer) : buffer(buffer) {
+    buffer->cold_pins++;
+}
+
+GapBuffer::ColdPin::ColdPin(const ColdPin &other) : buffer(other.buffer) {
+    if (buffer) buffer->cold_pins++;
+}
+
+GapBuffer::ColdPin &GapBuffer::ColdPin::operator=(ColdPin other) noexcept {
+    std::swap(buffer, other.buffer);
+    return *this;
+}
+
+GapBuffer::ColdPin::~ColdPin() {
+    if (buffer && --buffer->cold_pins == 0) buffer->trim_cold_cache();
+}
+
+GapBuffer::ColdPin GapBuffer::pin_cold_chunks() const {
+    return ColdPin{this};
+}
+
+void GapBuffer::thaw(int begin, int end) {
+    if (cold_chunks.empty() || begin >= end) return;
+    const auto chunk_size = cold_chunk_size();
+    for (auto chunk = begin / chunk_size; chunk <= (end - 1) / chunk_size; chunk++) {
+        if (!cold_chunks.contains(chunk)) continue;
+        load_cold_chunk(chunk);
+        cold_chunks.erase(chunk);
+        std::erase(cold_cache, chunk);
+    }
+}
+
+void GapBuffer::thaw_all() {
+    while (!cold_chunks.empty()) {
+        const auto chunk = cold_chunks.begin()->first;
+        thaw(chunk * cold_chunk_size(), chunk * cold_chunk_size() + 1);
+    }
+}
+
+bool GapBuffer::is_mapped() const {
+    return mapped;
+}
+
+std::optional<int> GapBuffer::find(std::string_view search, SearchOptions options) {
+    // Boyer-Moore runs over the stored text directly, so any staged edits have to be folded in first
+    fold_pending();
+    if (options != SearchOptions{}) return search_segments(*this, search, 0, options);
+    const auto searcher = std::boyer_moore_searcher(search.begin(), search.end());
+    const auto searchSize = static_cast<int>(search.size());
+    if (!cold_chunks.empty()) {
+        // searched a chunk at a time through the const interface, so that compressed chunks are only decompressed into the read cache.
+        // A match in a chunk always comes before one that straddles it & the next, so those are checked after, by hand
+        std::optional<int> found;
+        auto offset = 0;
+        std::as_const(*this).for_each_segment(0, size(), [&](std::span<const char> segment) {
+            const auto segment_begin = offset;
+            offset += static_cast<int>(segment.size());
+            if (const auto it = std::search(segment.begin(), segment.end(), searcher); it != segment.end()) {
+                found = segment_begin + static_cast<int>(std::distance(segment.begin(), it));
+                return false;
             }
-            if (matches) {
-                return i;
+            for (auto i = std::max(segment_begin, offset - searchSize + 1); i < offset && i + searchSize <= size(); i++) {
+                auto matches = true;
+                for (auto inner = 0; inner < searchSize && matches; inner++) matches = get_at(i + inner) == search[inner];
+                if (matches) {
+                    found = i;
+                    return false;
+                }
             }
+            return true;
+        });
+        return found;
+    }
+    auto begin = data;
+    auto e = data + gap_begin();
+    auto it = std::search(begin, e, searcher);
+    if (it != e) {
+        return std::distance(begin, it);
+    }
+    // Scan across gap boundary naively/brute force, i.e. only the positions where the needle starts before the gap and ends after it
+    for (auto i = std::max(0, gap_begin() - searchSize + 1); i < gap_begin() && i + searchSize <= size(); i++) {
+        auto matches = true;
+        for (auto inner = 0; inner < searchSize && matches; inner++) {
+            matches = get_at(i + inner) == search[inner];
         }
-        auto seg_begin = data + gap_begin() + gap_length();
-        auto seg_end = data + size() + gap_length();
-        auto iter = std::search(seg_begin, seg_end, std::boyer_moore_searcher(search.begin(), search.end()));
-        if (iter != seg_end) {
-            auto diff = std::distance(seg_begin, iter);
-            return diff + gap_begin();
+        if (matches) {
+            return i;
         }
     }
+    auto seg_begin = data + gap_begin() + gap_length();
+    auto seg_end = data + size() + gap_length();
+    auto iter = std::search(seg_begin, seg_end, searcher);
+    if (iter != seg_end) {
+        auto diff = std::distance(seg_begin, iter);
+        return diff + gap_begin();
+    }
     return {};
 }
 
-/// TODO: look for ways to optimize this. Due to the complexity of the gap in the gap buffer, right now we just do brute force when using find_from
-std::optional<int> GapBuffer::find_from(std::string_view search, std::optional<int> optionalPos) const {
-    auto sz = size();
-    int searchSize = search.size();
-    auto begin = optionalPos.value_or(0);
-    bool matches = false;
-    for(; begin < sz; begin++) {
-        for (auto inner = 0; inner < searchSize; inner++) {
-            auto ch = get_at(begin + inner);
-            char needle_ch = search[inner];
-            if (ch != needle_ch) {
-                matches = false;
-                break;
-            } else {
-                matches = true;
-            }
-        }
-        if(matches) return begin;
-    }
-    return {};
+std::optional<int> GapBuffer::find_from(std::string_view search, std::optional<int> pos, SearchOptions options) const {
+    return search_segments(*this, search, pos.value_or(0), options);
 }
 
 std::optional<int> GapBuffer::find_ch_from(char item, std::optional<int> pos) const {
@@ -284,22 +697,27 @@ std::optional<int> GapBuffer::find_ch_from(char item, std::optional<int> pos) co
 
 char &GapBuffer::operator[](int characterIndex) {
     GAP_BUFFER_ASSERT(characterIndex < size());
-    if (characterIndex >= state.gap.begin) {
-        auto result = data[characterIndex + gap_length()];
-        return data[characterIndex + gap_length()];
-    } else {
-        return data[characterIndex];
-    }
+    return get_at_ref(characterIndex);
 }
 
 char GapBuffer::get_at(int pos) const {
-    if (pos < state.gap.begin) return data[pos];
-    return data[pos + gap_length()];
+    return get_at_ref(pos);
 }
 
 char& GapBuffer::get_at_ref(int pos) {
-    if (pos < state.gap.begin) return data[pos];
-    return data[pos + gap_length()];
+    // locate() hands out addresses into storage this buffer owns, and *this is non-const here
+    auto &ch = const_cast<char &>(std::as_const(*this).get_at_ref(pos));
+    // the reference may be written through, which a compressed copy wouldn't see
+    if (!cold_chunks.empty() && &ch >= data && &ch < data + capacity()) thaw(static_cast<int>(&ch - data), static_cast<int>(&ch - data) + 1);
+    return ch;
+}
+
+const char& GapBuffer::get_at_ref(int pos) const {
+    if (pending.empty() && cold_chunks.empty()) [[likely]] {
+        if (pos < state.gap.begin) return data[pos];
+        return data[pos + gap_length()];
+    }
+    return *locate(pos);
 }
 
 int GapBuffer::gap_begin() const {
@@ -307,33 +725,181 @@ int GapBuffer::gap_begin() const {
 }
 
 std::string GapBuffer::clone_range(int begin, int length) const {
-    if(begin + length < gap_begin() || begin > (gap_begin() + gap_length())) {
-        std::string res;
-        res.reserve(length);
-        std::copy(data+begin, data+begin+length, std::back_inserter(res));
-        return res;
-    } else {
-        std::string res;
-        for(auto p = begin; p < begin + length; p++) {
-            res.push_back(get_at(p));
-        }
-        return res;
-    }
+    std::string res;
+    res.reserve(length);
+    for_each_segment(begin, begin + length, [&res](std::span<const char> segment) {
+        res.append(segment.data(), segment.size());
+    });
+    return res;
 }
 
 void GapBuffer::gap_commit() {
+    fold_pending();
     move_gap_cursor_to(state.cursor.pos);
 }
 
+void GapBuffer::set_edit_coalescing(EditCoalescing settings) {
+    coalescing = settings;
+    if (!coalescing.enabled) fold_pending();
+}
+
+const EditCoalescing &GapBuffer::edit_coalescing() const {
+    return coalescing;
+}
+
+void GapBuffer::flush_pending_edits() {
+    fold_pending();
+}
+
+int GapBuffer::pending_edit_count() const {
+    return static_cast<int>(pending.size());
+}
+
+int GapBuffer::pending_bytes() const {
+    auto bytes = 0;
+    for (const auto &edit : pending) bytes += static_cast<int>(edit.text.size());
+    return bytes;
+}
+
+const char *GapBuffer::locate(int pos) const {
+    auto delta = 0;
+    for (const auto &edit : pending) {
+        const auto edit_begin = edit.base_pos + delta;
+        if (pos < edit_begin) break;
+        if (pos < edit_begin + static_cast<int>(edit.text.size())) return edit.text.data() + (pos - edit_begin);
+        delta += static_cast<int>(edit.text.size()) - edit.removed;
+    }
+    const auto stored_pos = pos - delta;
+    const auto offset = stored_pos < state.gap.begin ? stored_pos : stored_pos + gap_length();
+    if (!cold_chunks.empty()) load_cold_chunk(offset / cold_chunk_size());
+    return data + offset;
+}
+
+void GapBuffer::write_at_gap(std::string_view text) {
+    const auto length = static_cast<int>(text.size());
+    if (length > state.gap.length) {
+        resize_gap(length + state.gap_starting_size);
+    }
+    std::memcpy(data + state.gap.begin, text.data(), length);
+    state.gap.begin += length;
+    state.gap.length -= length;
+    state.size += length;
+}
+
+bool GapBuffer::stage_insert(std::string_view text) {
+    const auto length = static_cast<int>(text.size());
+    if (!coalescing.enabled || length == 0) return false;
+    // the gap is already where the edit is, nothing is gained by staging it
+    if (pending.empty() && state.cursor.pos == state.gap.begin) return false;
+    if (pending_bytes() + length > coalescing.max_pending_bytes) {
+        if (pending.empty()) return false;
+        fold_pending();
+        return stage_insert(text);
+    }
+    const auto pos = state.cursor.pos;
+    auto delta = 0;
+    auto it = pending.begin();
+    for (; it != pending.end(); ++it) {
+        const auto edit_begin = it->base_pos + delta;
+        if (pos < edit_begin) break;
+        // inserting inside, or at either end of an already staged edit, just grows it
+        if (pos <= edit_begin + static_cast<int>(it->text.size())) {
+            it->text.insert(pos - edit_begin, text);
+            state.size += length;
+            advance_cursor(text);
+            return true;
+        }
+        delta += static_cast<int>(it->text.size()) - it->removed;
+    }
+    if (static_cast<int>(pending.size()) >= coalescing.max_pending_edits) {
+        fold_pending();
+        return stage_insert(text);
+    }
+    pending.insert(it, PendingEdit{pos - delta, 0, std::string{text}});
+    state.size += length;
+    advance_cursor(text);
+    return true;
+}
+
+bool GapBuffer::stage_erase(int begin, int end) {
+    if (!coalescing.enabled) return false;
+    if (pending.empty() && state.cursor.pos == state.gap.begin) return false;
+    auto delta = 0;
+    auto index = 0;
+    for (; index < static_cast<int>(pending.size()); index++) {
+        auto &edit = pending[index];
+        const auto edit_begin = edit.base_pos + delta;
+        const auto edit_end = edit_begin + static_cast<int>(edit.text.size());
+        if (end <= edit_begin) break;
+        if (begin >= edit_begin && end <= edit_end) {
+            // erasing text that was staged for insertion, never has to touch the stored text
+            edit.text.erase(begin - edit_begin, end - begin);
+            if (edit.text.empty() && edit.removed == 0) pending.erase(pending.begin() + index);
+            state.size -= end - begin;
+            return true;
+        }
+        if (begin < edit_end) {
+            // the range straddles staged & stored text. Fold, after which it is just a range of stored text
+            fold_pending();
+            return stage_erase(begin, end);
+        }
+        delta += static_cast<int>(edit.text.size()) - edit.removed;
+    }
+    if (static_cast<int>(pending.size()) >= coalescing.max_pending_edits) {
+        fold_pending();
+        return stage_erase(begin, end);
+    }
+    pending.insert(pending.begin() + index, PendingEdit{begin - delta, end - begin, {}});
+    // merge with the neighbours, if the erased range touches them, so that no two staged edits touch
+    if (index + 1 < static_cast<int>(pending.size())) {
+        auto &next = pending[index + 1];
+        if (pending[index].base_pos + pending[index].removed == next.base_pos) {
+            next.base_pos = pending[index].base_pos;
+            next.removed += pending[index].removed;
+            pending.erase(pending.begin() + index);
+        }
+    }
+    if (index > 0) {
+        auto &prev = pending[index - 1];
+        if (prev.base_pos + prev.removed == pending[index].base_pos) {
+            prev.removed += pending[index].removed;
+            prev.text += pending[index].text;
+            pending.erase(pending.begin() + index);
+        }
+    }
+    state.size -= end - begin;
+    return true;
+}
+
+void GapBuffer::fold_pending() {
+    if (pending.empty()) return;
+    auto edits = std::move(pending);
+    pending.clear();
+    auto delta = 0;
+    for (const auto &edit : edits) delta += static_cast<int>(edit.text.size()) - edit.removed;
+    // state.size is the size as seen by the user, i.e. including staged edits. While folding, it must describe the stored text
+    state.size -= delta;
+    delta = 0;
+    for (const auto &edit : edits) {
+        move_gap_cursor_to(edit.base_pos + delta);
+        // the erased text becomes part of the gap, and is written over; same as erase_forward, it can't stay in a compressed or shared chunk
+        thaw(state.gap.begin + state.gap.length, state.gap.begin + state.gap.length + edit.removed);
+        state.gap.length += edit.removed;
+        state.size -= edit.removed;
+        write_at_gap(edit.text);
+        delta += static_cast<int>(edit.text.size()) - edit.removed;
+    }
+}
+
 void GapBuffer::move_cursor_to(int index) {
     GAP_BUFFER_ASSERT(index <= size());
-    state.cursor.pos = index;
+    state.cursor = cursor_moved_to(index);
 }
 
 void GapBuffer::move_cursor_forward(int steps) {
-    state.cursor.pos = std::min(state.cursor.pos + steps, size());
+    state.cursor = cursor_moved_to(std::min(state.cursor.pos + steps, size()));
 }
 
 void GapBuffer::move_cursor_backward(int steps) {
-    state.cursor.pos = std::max(state.cursor.pos - steps, 0);
+    state.cursor = cursor_moved_to(std::max(state.cursor.pos - steps, 0));
 }
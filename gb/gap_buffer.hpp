@@ -3,8 +3,18 @@
 //
 
 #pragma once
+#include <algorithm>
+#include <compare>
+#include <cstddef>
+#include <iterator>
+#include <memory>
 #include <optional>
+#include <ranges>
+#include <span>
+#include <string>
 #include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #define GAP_BUFFER_ASSERT(BooleanExpr) assert(BooleanExpr)
@@ -21,6 +31,68 @@ struct Gap {
     int length;
 };
 
+/// A staged (not yet applied) edit, which replaces the stored text in [base_pos, base_pos + removed) with text. base_pos is a position in the
+/// stored text, i.e. the contents of data[] without the gap, and not a position in the text as seen by the user of the GapBuffer
+struct PendingEdit {
+    int base_pos;
+    int removed;
+    std::string text;
+};
+
+/// Settings for edit coalescing. When enabled, small inserts & erases at positions other than the gap are staged in a side buffer instead of moving the gap,
+/// and are folded into the buffer lazily, once one of the limits is hit, or when an operation needs the stored text to be contiguous
+struct EditCoalescing {
+    bool enabled{false};
+    int max_pending_edits{32};
+    int max_pending_bytes{4096};
+};
+
+/// Decides how the buffer's allocation grows & shrinks. Shrinking happens once the text drops below shrink_threshold of the capacity, down to a capacity
+/// where the text fills shrink_target of it. Keeping shrink_target well above shrink_threshold is what stops a buffer from oscillating between growing & shrinking.
+struct GrowthPolicy {
+    /// Capacity is multiplied by this, when the buffer has to grow
+    double growth_factor{2.0};
+    /// The most free space (gap included) a growth or a shrink leaves behind, so that a 1GB buffer grows by 64MB at a time, instead of by another 1GB
+    int max_gap_size{64 * 1024 * 1024};
+    double shrink_threshold{0.25};
+    double shrink_target{0.5};
+    /// Buffers are never shrunk below this capacity, so that small buffers don't reallocate at all
+    int min_capacity{4096};
+    /// Once the free space of a mapped buffer grows past this, its whole pages are handed back to the OS, without reallocating. A heap buffer
+    /// is reallocated instead, once its free space is past this & larger than its text
+    int release_threshold{1024 * 1024};
+    /// Buffers of at least this capacity are backed by virtual memory mappings instead of the heap, which on Linux lets them grow & shrink
+    /// with mremap, i.e. without copying the text over to a new allocation
+    int mmap_threshold{32 * 1024 * 1024};
+    /// Ask the OS to back mapped buffers with transparent huge pages
+    bool huge_pages{true};
+};
+
+/// Settings for cold storage, for very large buffers that mostly get read. Chunks of the text far from the gap can be compressed (see
+/// GapBuffer::compress_cold_chunks) and their pages handed back to the OS. Reads decompress a chunk back in place, and keep at most cache_chunks
+/// of them decompressed at once, evicting the least recently read one. Writing to a chunk, or moving text through it, decompresses it for good.
+/// Only mapped buffers (see GrowthPolicy::mmap_threshold) can hand pages back, so this does nothing for heap allocated ones.
+/// Reads through the non-const interface may write, so they decompress for good as well; read through a const GapBuffer& to keep chunks compressed.
+/// A span handed out by a const read is only good until the next read evicts its chunk, unless a GapBuffer::ColdPin is held. As const reads
+/// update the read cache, a buffer with compressed chunks (or chunks shared with a fork) must not be read from several threads at once, not
+/// even through const member functions, iterators or the algorithms in segmented.hpp; with cold storage off & no fork, const reads are safe
+struct ColdStorage {
+    bool enabled{false};
+    /// Rounded up to whole pages
+    int chunk_size{64 * 1024};
+    /// Chunks closer than this to the gap are left alone, as that is where edits happen
+    int gap_distance{4 * 1024 * 1024};
+    int cache_chunks{16};
+};
+
+/// Options for find & find_from. Case insensitive search folds ASCII, and the Latin, Greek & Cyrillic letters of UTF-8 text; other characters
+/// only match exactly. A whole word match is one without a word character (letters, digits, '_' & anything non-ASCII) right before or after it
+struct SearchOptions {
+    bool case_insensitive{false};
+    bool whole_word{false};
+    friend bool operator==(const SearchOptions &, const SearchOptions &) = default;
+};
+
 
 template<typename C> concept PushbackContainer = requires(C c) {
     c.push_back({});
@@ -31,11 +103,64 @@ template<typename Fn> concept Collector = requires(Fn fn) {
     fn(std::declval<std::vector<char>&>(), char{});
 };
 
-// TODO: add clone_range(begin, end)
+class GapBuffer;
+
+/// Random access iterator over the text contents of a GapBuffer, i.e. it never "sees" the gap. Dereferencing pays for the gap check on every access,
+/// so for bulk traversal, prefer the segment-aware algorithms in segmented.hpp, which run over the (at most two) contiguous spans directly
+template<bool Const>
+class GapBufferIterator {
+public:
+    using Buffer = std::conditional_t<Const, const GapBuffer, GapBuffer>;
+    using iterator_concept = std::random_access_iterator_tag;
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = char;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::conditional_t<Const, const char *, char *>;
+    using reference = std::conditional_t<Const, const char &, char &>;
+
+    GapBufferIterator() = default;
+    GapBufferIterator(Buffer *buffer, int pos) : m_buffer(buffer), m_pos(pos) {}
+    /// iterator -> const_iterator conversion
+    operator GapBufferIterator<true>() const requires(!Const) { return GapBufferIterator<true>{m_buffer, m_pos}; }
+
+    /// The segmented iterator protocol; segment-aware algorithms use the buffer & text position to walk the contiguous spans directly
+    Buffer *buffer() const { return m_buffer; }
+    int index() const { return m_pos; }
+
+    reference operator*() const { return m_buffer->get_at_ref(m_pos); }
+    reference operator[](difference_type n) const { return m_buffer->get_at_ref(m_pos + static_cast<int>(n)); }
+
+    GapBufferIterator &operator++() { ++m_pos; return *this; }
+    GapBufferIterator operator++(int) { auto tmp = *this; ++m_pos; return tmp; }
+    GapBufferIterator &operator--() { --m_pos; return *this; }
+    GapBufferIterator operator--(int) { auto tmp = *this; --m_pos; return tmp; }
+    GapBufferIterator &operator+=(difference_type n) { m_pos += static_cast<int>(n); return *this; }
+    GapBufferIterator &operator-=(difference_type n) { m_pos -= static_cast<int>(n); return *this; }
+
+    friend GapBufferIterator operator+(GapBufferIterator it, difference_type n) { return it += n; }
+    friend GapBufferIterator operator+(difference_type n, GapBufferIterator it) { return it += n; }
+    friend GapBufferIterator operator-(GapBufferIterator it, difference_type n) { return it -= n; }
+    friend difference_type operator-(const GapBufferIterator &lhs, const GapBufferIterator &rhs) { return lhs.m_pos - rhs.m_pos; }
+    friend bool operator==(const GapBufferIterator &lhs, const GapBufferIterator &rhs) { return lhs.m_pos == rhs.m_pos; }
+    friend auto operator<=>(const GapBufferIterator &lhs, const GapBufferIterator &rhs) { return lhs.m_pos <=> rhs.m_pos; }
+
+private:
+    Buffer *m_buffer{nullptr};
+    int m_pos{0};
+};
 
 class GapBuffer {
 public:
+    using iterator = GapBufferIterator<false>;
+    using const_iterator = GapBufferIterator<true>;
+    using value_type = char;
+
     explicit GapBuffer(int starting_capacity, int gap_size = 16);
+    GapBuffer(GapBuffer &&other) noexcept;
+    /// Deep copy of the text, laid out with the gap after it. See fork() for a copy that doesn't copy the text up front
+    GapBuffer(const GapBuffer &other);
+    GapBuffer &operator=(const GapBuffer &) = delete;
+    ~GapBuffer();
 
     /// Data member functions, either operates or retrieves the data
     char get_ch() const;
@@ -48,8 +173,62 @@ public:
     void erase_forward(int char_count = 1);
     /// erase char(s), backward as if user pressed "BACKSPACE", if DELETE-action is wanted, use erase_forward()
     void erase_backward(int char_count = 1);
-    /// clears the buffer, this is in a sense a "no-op", since it only sets the gap cursor to {0, buffer capacity}
+    /// Replaces text positions [pos, pos + length) with text. The gap is moved once, to whichever end of the range is closest (or not at all, if
+    /// it lies within the range), the erased text is absorbed into it & text is written in its place, so the buffer only grows if the text does.
+    /// A cursor after the range moves with the text after it, a cursor inside of it ends up after the replacement
+    void replace(int pos, int length, std::string_view text);
+    /// Erases text positions [pos, pos + length), i.e. replace() with nothing
+    void erase_range(int pos, int length);
+    /// clears the buffer, by setting the gap cursor to {0, buffer capacity}. If the capacity is above the growth policy's min_capacity, the buffer is also shrunk
     void clear();
+    /// Reallocates the buffer so that it holds the text and a gap of the starting gap size, and nothing more
+    void shrink_to_fit();
+    /// Replaces the contents with text, laid out with the gap at gap_position and at least gap_length long, and the cursor at 0.
+    /// Used to restore a buffer to a previously saved layout, without going through the edit paths
+    void assign(std::string_view text, int gap_position, int gap_length);
+    /// Moves the gap to the end of the text & makes it at least length long, then returns where it begins, so that text can be written into it
+    /// directly, by a file read for instance. The written text becomes part of the buffer with commit_append(). Until then the buffer must not
+    /// be edited, which also keeps the returned memory in place
+    char *prepare_append(int length);
+    void commit_append(int length);
+    void set_growth_policy(GrowthPolicy policy);
+    const GrowthPolicy& growth_policy() const;
+    /// Returns true if the buffer is currently backed by a virtual memory mapping, rather than by the heap
+    bool is_mapped() const;
+    /// Turns cold storage on or off. Turning it off decompresses all chunks
+    void set_cold_storage(ColdStorage settings);
+    const ColdStorage& cold_storage() const;
+    /// Compresses the chunks far enough from the gap that haven't been read recently, and releases their pages. Meant to be called when the
+    /// editor is idle. Returns the number of chunks compressed
+    int compress_cold_chunks();
+    /// Returns the number of compressed chunks, and the number of bytes their compressed copies take up
+    int cold_chunk_count() const;
+    std::size_t cold_bytes() const;
+    /// Returns a logically independent copy of this buffer, that shares its text copy-on-write. The storage is handed over to both buffers as
+    /// a read-only base, & each gets a fresh mapping whose pages are left untouched: a chunk (see ColdStorage::chunk_size) is copied over from
+    /// the base the first time it's read or written, through the same paths that decompress cold chunks. Only the chunks at the edges of the
+    /// gap & at the end of the text are copied up front, so forking costs O(chunks), not O(bytes). The base is freed once neither buffer needs it.
+    /// Heap allocated buffers are small enough to just be copied. Reallocating either buffer, or changing its cold storage settings, copies
+    /// over all of its shared chunks
+    GapBuffer fork();
+    /// Returns the number of chunks still shared with a fork, i.e. not yet copied over from the base
+    int shared_chunk_count() const;
+    /// Holds off evictions from the read cache of compressed chunks (see ColdStorage) while alive, so that spans handed out by const reads stay
+    /// valid after the read. Every chunk read meanwhile stays decompressed, and the cache shrinks back once the last pin is gone. The buffer must
+    /// outlive its pins, and not be moved while pinned
+    class ColdPin {
+    public:
+        ColdPin() = default;
+        ColdPin(const ColdPin &other);
+        ColdPin &operator=(ColdPin other) noexcept;
+        ~ColdPin();
+
+    private:
+        friend class GapBuffer;
+        explicit ColdPin(const GapBuffer *buffer);
+        const GapBuffer *buffer{nullptr};
+    };
+    ColdPin pin_cold_chunks() const;
     /// Clones the data between text positions [begin, begin+length)
     std::string clone_range(int begin, int length) const;
 
@@ -57,9 +236,10 @@ public:
 
     /// Returns position of cursor
     int pos() const;
-    /// Returns the line number of where the cursor is
+    /// Returns the line number of where the cursor is. Kept up to date by edits & cursor moves, which count the line breaks in the text they
+    /// touch or move over
     int line() const;
-    /// Returns the column position on current line
+    /// Returns the column position on current line, i.e. the characters between the line break before the cursor & the cursor
     int col_pos() const;
     /// Returns data contents size
     int size() const;
@@ -72,11 +252,19 @@ public:
     void move_cursor_forward(int steps);
     void move_cursor_backward(int steps);
 
+    /// Turns edit coalescing on or off. Turning it off folds all staged edits into the buffer
+    void set_edit_coalescing(EditCoalescing settings);
+    const EditCoalescing& edit_coalescing() const;
+    /// Folds all staged edits into the buffer. This moves the gap once per staged edit, in ascending position order
+    void flush_pending_edits();
+    /// Returns the number of staged edits that have not yet been folded into the buffer
+    int pending_edit_count() const;
+
     /// Find first instance of search in the buffer
-    std::optional<int> find(std::string_view search);
+    std::optional<int> find(std::string_view search, SearchOptions options = {});
 
-    /// Find first instance of search in the buffer, starting from (optional) pos
-    std::optional<int> find_from(std::string_view search, std::optional<int> pos = {}) const;
+    /// Find first instance of search in the buffer, starting from (optional) pos. Runs over the segments of the text in place, matches across the gap included
+    std::optional<int> find_from(std::string_view search, std::optional<int> pos = {}, SearchOptions options = {}) const;
     std::optional<int> find_ch_from(char item, std::optional<int> pos = {}) const;
 
     /// Returns character at characterIndex - meaning, this does not give access to the gap, inside of the gap buffer, only it's actual string contents
@@ -84,6 +272,25 @@ public:
 
     char get_at(int pos) const;
     char& get_at_ref(int pos);
+    const char& get_at_ref(int pos) const;
+
+    iterator begin() { return iterator{this, 0}; }
+    iterator end() { return iterator{this, size()}; }
+    const_iterator begin() const { return const_iterator{this, 0}; }
+    const_iterator end() const { return const_iterator{this, size()}; }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    /// Segmented access. Calls fn(std::span<char>) for each contiguous run of text in [begin, end). Normally this is at most two runs, the one before the gap
+    /// and the one after it, staged edits (see EditCoalescing) add a run each. If fn returns bool, returning false stops the walk. Returns false if the walk was stopped, true otherwise
+    template<typename Fn>
+    bool for_each_segment(int begin, int end, Fn fn) {
+        return walk_segments(*this, begin, end, fn);
+    }
+    template<typename Fn>
+    bool for_each_segment(int begin, int end, Fn fn) const {
+        return walk_segments(*this, begin, end, fn);
+    }
 
     inline int gap_begin() const;
     inline int gap_length() const;
@@ -111,8 +318,54 @@ public:
     } state;
 private:
     char *data;
+    /// Whether data was allocated with vmem::map (see GrowthPolicy::mmap_threshold) or new[]
+    bool mapped{false};
+    /// Staged edits, sorted by base_pos. No two edits touch each other, adjacent ones are merged when staged
+    std::vector<PendingEdit> pending;
+    EditCoalescing coalescing;
+    GrowthPolicy policy;
+    /// The amount of free space, the last time free pages were released. Used so that we don't call into the OS on every erase
+    int released_free_space{0};
+
+    /// Storage that fork() handed over to both buffers, freed with the last chunk that still refers to it
+    struct ForkBase {
+        char *data;
+        int capacity;
+        bool mapped;
+        ForkBase(char *data, int capacity, bool mapped) : data(data), capacity(capacity), mapped(mapped) {}
+        ForkBase(const ForkBase &) = delete;
+        ForkBase &operator=(const ForkBase &) = delete;
+        ~ForkBase() { free_storage(data, capacity, mapped); }
+    };
+    struct ColdChunk {
+        std::vector<char> compressed;
+        /// Whether the chunk is currently decompressed in place, i.e. in the read cache
+        bool resident;
+        /// Set for a chunk shared with a fork, instead of compressed: its contents are still in the base, & get copied over on first use
+        std::shared_ptr<const ForkBase> base{};
+    };
+    ColdStorage cold_settings;
+    /// Compressed chunks & chunks shared with a fork, by chunk index (storage offset / chunk size). Reading decompresses chunks, which is why
+    /// these are mutable. They never overlap the gap or the storage past the text, as those get written without being thawed first
+    mutable std::unordered_map<int, ColdChunk> cold_chunks;
+    /// Chunks decompressed for reading, least recently read first
+    mutable std::vector<int> cold_cache;
+    /// The number of live ColdPins. Nothing is evicted from cold_cache while there are any
+    mutable int cold_pins{0};
+
     void resize_gap(int gap_size);
+    /// Reallocates the buffer to new_size. The text is compacted around the gap, which takes up all the free space in the new allocation
     void resize_buffer_capacity(int new_size);
+    /// Allocates capacity bytes, mapped or on the heap depending on the growth policy. Sets is_mapped accordingly
+    char *allocate_storage(int capacity, bool &is_mapped) const;
+    static void free_storage(char *storage, int capacity, bool is_mapped);
+    /// Resizes mapped storage in place (or by page table relocation), moving the text after the gap so that the gap takes up all the free space.
+    /// Returns false if the platform couldn't remap, in which case nothing has changed
+    bool remap_storage(int new_size);
+    /// Grows the buffer according to the growth policy, if required_size doesn't fit in the current capacity
+    void ensure_capacity(int required_size);
+    /// Shrinks the buffer according to the growth policy, or releases the pages of a large gap to the OS (reallocates, for heap buffers)
+    void apply_shrink_policy();
 
     /// Commits the gap cursor to the text-cursor position. The separation of the gap vs text cursor is so that the user of the interface
     /// doesn't have to be concerned with where the gap is (currently), and so that when displayed for instance, the cursor can freely be moved around,
@@ -128,52 +381,139 @@ private:
     /// Moves cursor steps backward. If steps lies outside the range of the buffer, it clamps down to land within the range
     void move_gap_cursor_forward(int steps);
 
+    /// Returns the cursor as it would be at text position index: its line & column are counted over the text between it & index, and back to the
+    /// start of index's line if a line break is crossed going backwards
+    BufferCursor cursor_moved_to(int index) const;
+    /// Moves the cursor past text, just inserted at it
+    void advance_cursor(std::string_view text);
+    int count_line_breaks(int begin, int end) const;
+    /// Returns the start of the line text position pos is on
+    int line_start_before(int pos) const;
+
     int remaining_space() const;
+
+    /// Writes text at the gap, growing the gap if it's too small to hold it
+    void write_at_gap(std::string_view text);
+    /// Tries to stage an insert of text at the cursor position. Returns false if the edit must be applied directly instead
+    bool stage_insert(std::string_view text);
+    /// Tries to stage an erase of text positions [begin, end). Returns false if the edit must be applied directly instead
+    bool stage_erase(int begin, int end);
+    /// Folds staged edits into the buffer, without touching the cursor
+    void fold_pending();
+    int pending_bytes() const;
+    /// Returns the address of the character at text position pos, which either lives in data[] or in the text of a staged edit
+    const char *locate(int pos) const;
+
+    int cold_chunk_size() const;
+    /// Makes sure a compressed chunk is decompressed in place, for reading
+    void load_cold_chunk(int chunk) const;
+    /// Evicts the least recently read chunks, until the read cache is down to ColdStorage::cache_chunks. Does nothing while pinned
+    void trim_cold_cache() const;
+    /// Decompresses the chunks overlapping storage offsets [begin, end) for good, before that storage is moved or written
+    void thaw(int begin, int end);
+    void thaw_all();
+    /// Private counterpart of fork(): a copy of other's state & settings that takes its text from base
+    GapBuffer(const GapBuffer &other, const std::shared_ptr<const ForkBase> &base);
+    /// Points the chunks of the stored text at base, which holds the text as currently laid out, in a fresh allocation
+    void share_chunks(const std::shared_ptr<const ForkBase> &base);
+
+    template<typename Self, typename Fn>
+    static bool walk_segments(Self &self, int begin, int end, Fn &fn) {
+        using Char = std::conditional_t<std::is_const_v<Self>, const char, char>;
+        const auto segment_fn = [&fn](Char *first, int length) {
+            if (length <= 0) return true;
+            if constexpr (std::is_void_v<std::invoke_result_t<Fn &, std::span<Char>>>) {
+                fn(std::span<Char>{first, static_cast<std::size_t>(length)});
+                return true;
+            } else {
+                return static_cast<bool>(fn(std::span<Char>{first, static_cast<std::size_t>(length)}));
+            }
+        };
+        // Walks storage [b, e). With compressed chunks around, it's walked a chunk at a time, decompressing each before it's handed out
+        const auto storage_fn = [&self, &segment_fn](int b, int e) {
+            if (self.cold_chunks.empty()) [[likely]] return segment_fn(self.data + b, e - b);
+            const auto chunk_size = self.cold_chunk_size();
+            while (b < e) {
+                const auto chunk = b / chunk_size;
+                const auto run_end = std::min(e, (chunk + 1) * chunk_size);
+                if constexpr (std::is_const_v<Self>) {
+                    self.load_cold_chunk(chunk);
+                    // fn may read more of the buffer, e.g. to compare two ranges of it, which mustn't evict the chunk it's been handed
+                    const auto pin = self.pin_cold_chunks();
+                    if (!segment_fn(self.data + b, run_end - b)) return false;
+                } else {
+                    self.thaw(b, run_end);
+                    if (!segment_fn(self.data + b, run_end - b)) return false;
+                }
+                b = run_end;
+            }
+            return true;
+        };
+        // Walks stored text positions [b, e), i.e. the runs on either side of the gap
+        const auto stored_fn = [&self, &storage_fn](int b, int e) {
+            if (b < self.state.gap.begin) {
+                const auto first_end = std::min(e, self.state.gap.begin);
+                if (!storage_fn(b, first_end)) return false;
+                b = first_end;
+            }
+            return b >= e || storage_fn(b + self.state.gap.length, e + self.state.gap.length);
+        };
+        // Staged edits split the stored text into more runs. delta is the difference between text positions and stored text positions
+        auto delta = 0;
+        for (auto &edit : self.pending) {
+            if (begin >= end) return true;
+            const auto edit_begin = edit.base_pos + delta;
+            const auto edit_end = edit_begin + static_cast<int>(edit.text.size());
+            if (begin < edit_begin) {
+                const auto run_end = std::min(end, edit_begin);
+                if (!stored_fn(begin - delta, run_end - delta)) return false;
+                begin = run_end;
+            }
+            if (begin < end && begin < edit_end) {
+                const auto run_end = std::min(end, edit_end);
+                if (!segment_fn(edit.text.data() + (begin - edit_begin), run_end - begin)) return false;
+                begin = run_end;
+            }
+            delta += static_cast<int>(edit.text.size()) - edit.removed;
+        }
+        return begin >= end || stored_fn(begin - delta, end - delta);
+    }
     // This is put down here to not clutter up the interface
 public:
 
     template <Collector Fn>
     std::vector<char> collect_from(int pos, int to, Fn fn) {
         std::vector<char> result{};
-        auto& Self = *this;
-        for(auto i = pos; i < to; i++) {
-            fn(result, char{Self[i]});
-        }
+        for_each_segment(pos, to, [&](std::span<char> segment) {
+            for (auto ch : segment) fn(result, ch);
+        });
         return result;
     }
 
     template <Collector Fn>
     std::vector<char> collect_x_from(int pos, int x, Fn fn) {
-        std::vector<char> result{};
-        auto& Self = *this;
-        auto to = pos + x;
-        for(auto i = pos; i < to; i++) {
-            auto ch = Self[i];
-            fn(result, ch);
-        }
-        return result;
+        return collect_from(pos, pos + x, fn);
     }
 
     template <typename Fn>
     void for_each_character(Fn fn) {
-        const auto sz = size();
-        for(auto i = 0; i < sz; i++) {
-            fn(this->operator[](i));
-        }
+        for_each_segment(0, size(), [&](std::span<char> segment) {
+            for (auto &ch : segment) fn(ch);
+        });
     }
     template <typename Fn, PushbackContainer Container>
     void transform(Container& container, Fn fn) {
-        auto& Self = *this;
-        const auto sz = size();
-        for(auto i = 0; i < sz; i++) {
-            fn(container, Self[i]);
-        }
+        for_each_segment(0, size(), [&](std::span<char> segment) {
+            for (auto ch : segment) fn(container, ch);
+        });
     }
 
 
     /// Applies fn to each character in this buffer, including the gap, which in this case is represnted by characters of '_' (underscores)
     template<typename PrintFn>
     void debug_print_contents(PrintFn fn, bool print_gap_characters = true) {
+        fold_pending();
+        thaw_all();
         for (auto i = 0; i < state.gap.begin; i++) {
             fn(data[i]);
         }
@@ -192,6 +532,8 @@ public:
 #ifdef GBDEBUG
     template<typename DebugFn>
     bool debug_assert(std::string_view contents_match, DebugFn fn) {
+        fold_pending();
+        thaw_all();
         if (size() != contents_match.size()) {
             return false;
         }
@@ -211,6 +553,11 @@ public:
 #endif
 };
 
+static_assert(std::random_access_iterator<GapBuffer::iterator>);
+static_assert(std::random_access_iterator<GapBuffer::const_iterator>);
+static_assert(std::ranges::random_access_range<GapBuffer>);
+static_assert(std::ranges::sized_range<GapBuffer>);
+
 // 0123456789ABCDEF
 // hello ___world
 // gap.begin = 6
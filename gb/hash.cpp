@@ -0,0 +1,109 @@
+//
+// Created by 46769 on 2021-02-08.
+//
+
+#include "hash.hpp"
+#include <cstring>
+
+static constexpr std::uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static constexpr std::uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr std::uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static constexpr std::uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr std::uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline std::uint64_t rotl(std::uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// The spec defines the input as little endian, which is what every platform we build for is
+static inline std::uint64_t read64(const unsigned char *p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline std::uint32_t read32(const unsigned char *p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline std::uint64_t xxh_round(std::uint64_t acc, std::uint64_t lane) {
+    acc += lane * PRIME64_2;
+    acc = rotl(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline std::uint64_t merge_round(std::uint64_t acc, std::uint64_t value) {
+    acc ^= xxh_round(0, value);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+static inline std::uint64_t finalize(std::uint64_t h, const unsigned char *p, std::size_t length) {
+    for (; length >= 8; length -= 8, p += 8) {
+        h ^= xxh_round(0, read64(p));
+        h = rotl(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (length >= 4) {
+        h ^= static_cast<std::uint64_t>(read32(p)) * PRIME64_1;
+        h = rotl(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+        length -= 4;
+    }
+    for (; length > 0; length--, p++) {
+        h ^= *p * PRIME64_5;
+        h = rotl(h, 11) * PRIME64_1;
+    }
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline std::uint64_t converge(const std::uint64_t (&acc)[4]) {
+    auto h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+    for (auto lane : acc) h = merge_round(h, lane);
+    return h;
+}
+
+std::uint64_t xxh64(const void *input, std::size_t length, std::uint64_t seed) {
+    Xxh64Stream stream{seed};
+    stream.update(input, length);
+    return stream.digest();
+}
+
+Xxh64Stream::Xxh64Stream(std::uint64_t seed) : acc{seed + PRIME64_1 + PRIME64_2, seed + PRIME64_2, seed, seed - PRIME64_1}, seed(seed), stripe{} {}
+
+void Xxh64Stream::update(const void *input, std::size_t length) {
+    auto p = static_cast<const unsigned char *>(input);
+    total_length += length;
+    if (stripe_length + length < sizeof(stripe)) {
+        std::memcpy(stripe + stripe_length, p, length);
+        stripe_length += length;
+        return;
+    }
+    if (stripe_length > 0) {
+        const auto fill = sizeof(stripe) - stripe_length;
+        std::memcpy(stripe + stripe_length, p, fill);
+        for (auto i = 0; i < 4; i++) acc[i] = xxh_round(acc[i], read64(stripe + i * 8));
+        p += fill;
+        length -= fill;
+        stripe_length = 0;
+    }
+    for (; length >= sizeof(stripe); length -= sizeof(stripe), p += sizeof(stripe)) {
+        acc[0] = xxh_round(acc[0], read64(p));
+        acc[1] = xxh_round(acc[1], read64(p + 8));
+        acc[2] = xxh_round(acc[2], read64(p + 16));
+        acc[3] = xxh_round(acc[3], read64(p + 24));
+    }
+    std::memcpy(stripe, p, length);
+    stripe_length = length;
+}
+
+std::uint64_t Xxh64Stream::digest() const {
+    auto h = total_length >= sizeof(stripe) ? converge(acc) : seed + PRIME64_5;
+    h += total_length;
+    return finalize(h, stripe, stripe_length);
+}
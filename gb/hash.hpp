@@ -0,0 +1,27 @@
+//
+// Created by 46769 on 2021-02-08.
+//
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/// XXH64, as specified by https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md. Used for snapshot checksums & content hashing
+std::uint64_t xxh64(const void *input, std::size_t length, std::uint64_t seed = 0);
+
+/// Streaming XXH64, for input that isn't contiguous, like the segments of a GapBuffer. Produces the same digest as xxh64() over the concatenated input
+class Xxh64Stream {
+public:
+    explicit Xxh64Stream(std::uint64_t seed = 0);
+    void update(const void *input, std::size_t length);
+    void update(std::span<const char> input) { update(input.data(), input.size()); }
+    std::uint64_t digest() const;
+
+private:
+    std::uint64_t acc[4];
+    std::uint64_t seed;
+    std::uint64_t total_length{0};
+    unsigned char stripe[32];
+    std::size_t stripe_length{0};
+};
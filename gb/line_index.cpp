@@ -0,0 +1,78 @@
+//
+// Created by 46769 on 2021-02-08.
+//
+
+#include "line_index.hpp"
+#include "gap_buffer.hpp"
+#include <algorithm>
+
+void LineIndex::rebuild(const GapBuffer &buffer) {
+    line_starts.assign(1, 0);
+    auto offset = 0;
+    buffer.for_each_segment(0, buffer.size(), [&](std::span<const char> segment) {
+        for (auto i = 0; i < static_cast<int>(segment.size()); i++) {
+            if (segment[i] == '\n') line_starts.push_back(offset + i + 1);
+        }
+        offset += static_cast<int>(segment.size());
+    });
+}
+
+void LineIndex::assign(std::span<const int> starts) {
+    line_starts.assign(starts.begin(), starts.end());
+    if (line_starts.empty()) line_starts.push_back(0);
+}
+
+void LineIndex::on_insert(int pos, std::string_view text) {
+    const auto length = static_cast<int>(text.size());
+    // lines beginning after pos are pushed forward. A line beginning exactly at pos stays put, the inserted text becomes the start of it
+    auto it = std::upper_bound(line_starts.begin() + 1, line_starts.end(), pos);
+    for (auto shifted = it; shifted != line_starts.end(); ++shifted) *shifted += length;
+    std::vector<int> inserted;
+    for (auto i = 0; i < length; i++) {
+        if (text[i] == '\n') inserted.push_back(pos + i + 1);
+    }
+    line_starts.insert(it, inserted.begin(), inserted.end());
+}
+
+void LineIndex::on_erase(int pos, int length) {
+    // a line beginning in (pos, pos + length] began after a newline that was erased
+    auto first = std::upper_bound(line_starts.begin() + 1, line_starts.end(), pos);
+    auto last = std::upper_bound(first, line_starts.end(), pos + length);
+    for (auto shifted = last; shifted != line_starts.end(); ++shifted) *shifted -= length;
+    line_starts.erase(first, last);
+}
+
+void LineIndex::on_replace(int pos, int length, std::string_view text) {
+    const auto delta = static_cast<int>(text.size()) - length;
+    auto first = std::upper_bound(line_starts.begin() + 1, line_starts.end(), pos);
+    auto last = std::upper_bound(first, line_starts.end(), pos + length);
+    for (auto shifted = last; shifted != line_starts.end(); ++shifted) *shifted += delta;
+    std::vector<int> inserted;
+    for (auto i = 0; i < static_cast<int>(text.size()); i++) {
+        if (text[i] == '\n') inserted.push_back(pos + i + 1);
+    }
+    // overwrite the starts of the erased lines with those of the inserted ones, and only insert or erase the difference
+    const auto common = std::min<std::ptrdiff_t>(last - first, static_cast<std::ptrdiff_t>(inserted.size()));
+    first = std::copy(inserted.begin(), inserted.begin() + common, first);
+    if (first != last) {
+        line_starts.erase(first, last);
+    } else {
+        line_starts.insert(first, inserted.begin() + common, inserted.end());
+    }
+}
+
+int LineIndex::line_count() const {
+    return static_cast<int>(line_starts.size());
+}
+
+int LineIndex::line_start(int line) const {
+    return line_starts[line];
+}
+
+int LineIndex::line_of(int pos) const {
+    return static_cast<int>(std::upper_bound(line_starts.begin(), line_starts.end(), pos) - line_starts.begin()) - 1;
+}
+
+const std::vector<int> &LineIndex::starts() const {
+    return line_starts;
+}
@@ -0,0 +1,36 @@
+//
+// Created by 46769 on 2021-02-08.
+//
+
+#pragma once
+#include <span>
+#include <string_view>
+#include <vector>
+
+class GapBuffer;
+
+/// Keeps track of where each line begins in a GapBuffer. Line starts are text positions, the first line always begins at 0,
+/// and every '\n' begins a new line at the position after it
+class LineIndex {
+public:
+    LineIndex() = default;
+    /// Rebuilds the index by scanning the whole buffer
+    void rebuild(const GapBuffer &buffer);
+    /// Replaces the index with already computed line starts, for instance ones restored from a snapshot
+    void assign(std::span<const int> starts);
+    /// Updates the index after text was inserted at pos
+    void on_insert(int pos, std::string_view text);
+    /// Updates the index after the text positions [pos, pos + length) were erased
+    void on_erase(int pos, int length);
+    /// Updates the index after the text positions [pos, pos + length) were replaced with text, in one pass over the line starts after pos
+    void on_replace(int pos, int length, std::string_view text);
+
+    int line_count() const;
+    int line_start(int line) const;
+    /// Returns the (0-based) line that text position pos lies on
+    int line_of(int pos) const;
+    const std::vector<int> &starts() const;
+
+private:
+    std::vector<int> line_starts{0};
+};
@@ -0,0 +1,180 @@
+//
+// Created by 46769 on 2021-02-19.
+//
+
+#include "line_ops.hpp"
+#include "simd.hpp"
+#include "text.hpp"
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    struct Line {
+        std::string_view content;
+        /// "\n", "\r\n", or nothing for the last line of the text
+        std::string_view eol;
+    };
+
+    /// A copy of a range of whole lines, split up
+    struct LineRange {
+        int begin{0};
+        std::string text;
+        std::vector<Line> lines;
+    };
+
+    LineRange read_lines(const Text &text, int first_line, int last_line) {
+        const auto &index = text.lines();
+        first_line = std::clamp(first_line, 0, index.line_count() - 1);
+        last_line = std::clamp(last_line, first_line, index.line_count() - 1);
+        LineRange range;
+        range.begin = index.line_start(first_line);
+        const auto end = last_line + 1 < index.line_count() ? index.line_start(last_line + 1) : text.size();
+        range.text = text.buffer().clone_range(range.begin, end - range.begin);
+        const std::string_view contents{range.text};
+        for (std::size_t begin = 0; begin <= contents.size();) {
+            auto newline = contents.find('\n', begin);
+            if (newline == std::string_view::npos) {
+                // the last line of the text. If the range ends with a newline, the empty line after it isn't part of the range
+                if (begin < contents.size() || range.lines.empty()) range.lines.push_back({contents.substr(begin), {}});
+                break;
+            }
+            auto content_end = newline;
+            if (content_end > begin && contents[content_end - 1] == '\r') content_end--;
+            range.lines.push_back({contents.substr(begin, content_end - begin), contents.substr(content_end, newline + 1 - content_end)});
+            begin = newline + 1;
+        }
+        return range;
+    }
+
+    /// Replaces the range with output, or rather the part of it that differs, so that markers & dirty ranges around the changes are left be
+    void splice(Text &text, const LineRange &range, std::string_view output) {
+        const std::string_view input{range.text};
+        const auto shorter = std::min(input.size(), output.size());
+        const auto prefix = simd::common_prefix(input.data(), output.data(), shorter);
+        if (prefix == input.size() && prefix == output.size()) return;
+        const auto suffix = simd::common_suffix(input.data() + input.size(), output.data() + output.size(), shorter - prefix);
+        text.replace(range.begin + static_cast<int>(prefix), static_cast<int>(input.size() - prefix - suffix), output.substr(prefix, output.size() - prefix - suffix));
+    }
+
+    /// Builds the output by calling fn(line, output) for every line, which appends the line's new contents, and splices it in
+    template<typename Fn>
+    void rewrite_lines(Text &text, int first_line, int last_line, Fn fn) {
+        const auto range = read_lines(text, first_line, last_line);
+        std::string output;
+        output.reserve(range.text.size() + range.text.size() / 8);
+        for (const auto &line : range.lines) {
+            fn(line, output);
+            output.append(line.eol);
+        }
+        splice(text, range, output);
+    }
+
+    std::size_t leading_whitespace(std::string_view line) {
+        return std::min(line.find_first_not_of(" \t"), line.size());
+    }
+
+    bool is_blank(std::string_view line) {
+        return leading_whitespace(line) == line.size();
+    }
+
+    template<typename Compare>
+    void parallel_stable_sort(std::vector<std::string_view> &lines, Compare compare) {
+        const auto parts = static_cast<int>(std::min<std::size_t>(std::thread::hardware_concurrency(), lines.size() / (ParallelSortLines / 4)));
+        if (static_cast<int>(lines.size()) <= ParallelSortLines || parts < 2) {
+            std::stable_sort(lines.begin(), lines.end(), compare);
+            return;
+        }
+        // each part is sorted on a thread of its own, then neighbouring parts are merged, pairwise & in parallel, until one is left
+        std::vector<std::size_t> bounds;
+        for (auto i = 0; i <= parts; i++) bounds.push_back(lines.size() * i / parts);
+        const auto begin = lines.begin();
+        std::vector<std::thread> workers;
+        for (auto i = 0; i < parts; i++) workers.emplace_back([&, i] { std::stable_sort(begin + bounds[i], begin + bounds[i + 1], compare); });
+        for (auto &worker : workers) worker.join();
+        for (auto width = 1; width < parts; width *= 2) {
+            workers.clear();
+            for (auto i = 0; i + width < parts; i += 2 * width) {
+                workers.emplace_back([&, i, width] { std::inplace_merge(begin + bounds[i], begin + bounds[i + width], begin + bounds[std::min(i + 2 * width, parts)], compare); });
+            }
+            for (auto &worker : workers) worker.join();
+        }
+    }
+}// namespace
+
+void indent_lines(Text &text, int first_line, int last_line, std::string_view indent) {
+    rewrite_lines(text, first_line, last_line, [indent](const Line &line, std::string &output) {
+        if (!line.content.empty()) output.append(indent);
+        output.append(line.content);
+    });
+}
+
+void unindent_lines(Text &text, int first_line, int last_line, int tab_width) {
+    rewrite_lines(text, first_line, last_line, [tab_width](const Line &line, std::string &output) {
+        auto content = line.content;
+        if (content.starts_with('\t')) {
+            content.remove_prefix(1);
+        } else {
+            content.remove_prefix(std::min<std::size_t>(content.find_first_not_of(' '), std::min<std::size_t>(tab_width, content.size())));
+        }
+        output.append(content);
+    });
+}
+
+void toggle_line_comment(Text &text, int first_line, int last_line, std::string_view prefix) {
+    const auto range = read_lines(text, first_line, last_line);
+    const auto marker = prefix.substr(0, prefix.find_last_not_of(' ') + 1);
+    auto commented = true;
+    auto indentation = std::string_view::npos;
+    for (const auto &line : range.lines) {
+        if (is_blank(line.content)) continue;
+        const auto leading = leading_whitespace(line.content);
+        commented = commented && line.content.substr(leading).starts_with(marker);
+        indentation = std::min(indentation, leading);
+    }
+    if (indentation == std::string_view::npos) return;
+
+    std::string output;
+    output.reserve(range.text.size() + range.lines.size() * prefix.size());
+    for (const auto &line : range.lines) {
+        if (is_blank(line.content)) {
+            output.append(line.content);
+        } else if (commented) {
+            const auto leading = leading_whitespace(line.content);
+            auto rest = line.content.substr(leading + marker.size());
+            // the spaces after the marker are only removed as far as they're part of prefix
+            for (auto i = marker.size(); i < prefix.size() && rest.starts_with(' '); i++) rest.remove_prefix(1);
+            output.append(line.content.substr(0, leading)).append(rest);
+        } else {
+            output.append(line.content.substr(0, indentation)).append(prefix).append(line.content.substr(indentation));
+        }
+        output.append(line.eol);
+    }
+    splice(text, range, output);
+}
+
+void trim_trailing_whitespace(Text &text, int first_line, int last_line) {
+    rewrite_lines(text, first_line, last_line, [](const Line &line, std::string &output) {
+        const auto end = line.content.find_last_not_of(" \t");
+        output.append(line.content.substr(0, end == std::string_view::npos ? 0 : end + 1));
+    });
+}
+
+void sort_lines(Text &text, int first_line, int last_line, bool descending) {
+    const auto range = read_lines(text, first_line, last_line);
+    std::vector<std::string_view> sorted;
+    sorted.reserve(range.lines.size());
+    for (const auto &line : range.lines) sorted.push_back(line.content);
+    if (descending) {
+        parallel_stable_sort(sorted, std::greater<>{});
+    } else {
+        parallel_stable_sort(sorted, std::less<>{});
+    }
+    // line endings stay where they were, so that a range without a final newline still doesn't have one
+    std::string output;
+    output.reserve(range.text.size());
+    for (std::size_t i = 0; i < sorted.size(); i++) output.append(sorted[i]).append(range.lines[i].eol);
+    splice(text, range, output);
+}
@@ -0,0 +1,26 @@
+//
+// Created by 46769 on 2021-02-19.
+//
+
+#pragma once
+#include <string_view>
+
+class Text;
+
+/// Bulk operations over the lines [first_line, last_line] of a Text. Each one reads the lines once, computes what they turn into, and replaces
+/// only the part that changed with one Text::replace, i.e. one gap move, one pass over the line index & one change event, however many lines
+/// are affected. Line numbers are clamped to the text. A trailing "\r" counts as part of the line ending, not the line
+
+/// Prepends indent to every non-empty line
+void indent_lines(Text &text, int first_line, int last_line, std::string_view indent);
+/// Removes one level of indentation from every line: a leading tab, or up to tab_width leading spaces
+void unindent_lines(Text &text, int first_line, int last_line, int tab_width);
+/// Comments the lines out with prefix (e.g. "// "), inserted at the indentation of the least indented one, unless every non-blank line
+/// already starts with it (trailing spaces of prefix being optional), in which case it's removed instead. Blank lines are left alone
+void toggle_line_comment(Text &text, int first_line, int last_line, std::string_view prefix);
+/// Removes the spaces & tabs at the end of every line
+void trim_trailing_whitespace(Text &text, int first_line, int last_line);
+/// Sorts the lines by their bytes, stably. Ranges of more than ParallelSortLines lines are sorted in parallel
+void sort_lines(Text &text, int first_line, int last_line, bool descending = false);
+
+constexpr int ParallelSortLines = 64 * 1024;
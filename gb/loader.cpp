@@ -0,0 +1,234 @@
+//
+// Created by 46769 on 2021-02-13.
+//
+
+#include "loader.hpp"
+#include "gap_buffer.hpp"
+#include "text.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fstream>
+
+/// Returns the length a UTF-8 sequence beginning with lead claims to have, or 0 if lead can't begin a sequence
+static int utf8_length(unsigned char lead) {
+    if (lead < 0x80) return 1;
+    if (lead >= 0xC2 && lead <= 0xDF) return 2;
+    if (lead >= 0xE0 && lead <= 0xEF) return 3;
+    if (lead >= 0xF0 && lead <= 0xF4) return 4;
+    return 0;
+}
+
+/// Returns the length of the valid UTF-8 sequence at p, or 0 if it isn't one (overlong forms & surrogates included)
+static int utf8_sequence(const unsigned char *p, std::size_t available) {
+    const auto length = utf8_length(p[0]);
+    if (length <= 1 || static_cast<std::size_t>(length) > available) return length == 1 ? 1 : 0;
+    const auto min_second = p[0] == 0xE0 ? 0xA0 : p[0] == 0xF0 ? 0x90 : 0x80;
+    const auto max_second = p[0] == 0xED ? 0x9F : p[0] == 0xF4 ? 0x8F : 0xBF;
+    if (p[1] < min_second || p[1] > max_second) return 0;
+    for (auto i = 2; i < length; i++) {
+        if ((p[i] & 0xC0) != 0x80) return 0;
+    }
+    return length;
+}
+
+FileLoader::FileLoader(const std::filesystem::path &path, GapBuffer &buffer, int chunk_size, int worker_count)
+    : buffer(&buffer), chunk_size(std::max(chunk_size, 64)) {
+    start(path, worker_count);
+}
+
+FileLoader::FileLoader(const std::filesystem::path &path, Text &text, int chunk_size, int worker_count)
+    : buffer(&text.gap_buffer), text(&text), chunk_size(std::max(chunk_size, 64)) {
+    text.clear();
+    start(path, worker_count);
+}
+
+FileLoader::~FileLoader() {
+    cancelled = true;
+    if (reader.joinable()) reader.join();
+    for (auto &worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+void FileLoader::start(const std::filesystem::path &path, int worker_count) {
+    std::error_code error_code;
+    const auto file_size = std::filesystem::file_size(path, error_code);
+    if (error_code) {
+        load_error = LoadError::OpenFailed;
+    } else if (file_size > static_cast<std::uintmax_t>(INT_MAX - buffer->growth_policy().max_gap_size)) {
+        // text positions are ints
+        load_error = LoadError::TooLarge;
+    }
+    if (load_error != LoadError::None) {
+        read_done = true;
+        return;
+    }
+    size = static_cast<int>(file_size);
+    buffer->clear();
+    destination = buffer->prepare_append(size);
+    chunk_count = static_cast<int>((static_cast<long long>(size) + chunk_size - 1) / chunk_size);
+    scans.resize(chunk_count);
+
+    reader = std::thread{&FileLoader::read_file, this, path};
+    if (worker_count <= 0) worker_count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+    worker_count = std::min(worker_count, std::max(chunk_count, 1));
+    for (auto i = 0; i < worker_count; i++) workers.emplace_back(&FileLoader::index_chunks, this);
+}
+
+void FileLoader::read_file(std::filesystem::path path) {
+    std::ifstream file{path, std::ios::binary};
+    auto result = file ? LoadError::None : LoadError::OpenFailed;
+    for (auto offset = 0; result == LoadError::None && offset < size && !cancelled; offset += std::min(chunk_size, size - offset)) {
+        const auto length = std::min(chunk_size, size - offset);
+        file.read(destination + offset, length);
+        if (file.gcount() != length) {
+            result = LoadError::ReadFailed;
+            break;
+        }
+        {
+            // published under the lock, so that a worker can't check the count & then miss the wake up
+            std::lock_guard lock{mutex};
+            loaded.store(offset + length, std::memory_order_release);
+        }
+        progress.notify_all();
+    }
+    {
+        std::lock_guard lock{mutex};
+        if (result == LoadError::None && loaded < size) result = LoadError::ReadFailed;
+        load_error = result;
+        read_done = true;
+    }
+    progress.notify_all();
+}
+
+void FileLoader::index_chunks() {
+    for (;;) {
+        const auto chunk = next_chunk.fetch_add(1);
+        if (chunk >= chunk_count) return;
+        const auto begin = chunk * chunk_size;
+        const auto end = size - begin > chunk_size ? begin + chunk_size : size;
+        if (wait_for(end) < end) return;
+        scan_chunk(chunk);
+    }
+}
+
+void FileLoader::scan_chunk(int chunk) {
+    auto &scan = scans[chunk];
+    const auto begin = chunk * chunk_size;
+    const auto end = size - begin > chunk_size ? begin + chunk_size : size;
+    const auto bytes = reinterpret_cast<const unsigned char *>(destination);
+
+    for (auto p = destination + begin; (p = static_cast<char *>(std::memchr(p, '\n', destination + end - p))) != nullptr; p++) {
+        const auto pos = static_cast<int>(p - destination);
+        scan.line_starts.push_back(pos + 1);
+        if (pos > begin && destination[pos - 1] == '\r') scan.crlf_count++;
+    }
+
+    scan.ascii = std::none_of(bytes + begin, bytes + end, [](unsigned char ch) { return ch & 0x80; });
+    if (scan.ascii) return;
+    auto i = begin;
+    while (scan.leading_continuations < 3 && i < end && (bytes[i] & 0xC0) == 0x80) {
+        scan.leading_continuations++;
+        i++;
+    }
+    while (i < end) {
+        if (bytes[i] < 0x80) {
+            i++;
+            continue;
+        }
+        const auto length = utf8_length(bytes[i]);
+        if (length != 0 && i + length > end) {
+            scan.cut_sequence = i;
+            return;
+        }
+        if (length == 0 || utf8_sequence(bytes + i, end - i) == 0) {
+            scan.valid_utf8 = false;
+            return;
+        }
+        i += length;
+    }
+}
+
+void FileLoader::merge_scans() {
+    const auto bytes = reinterpret_cast<const unsigned char *>(destination);
+    merged_line_starts.assign(1, 0);
+    merged_encoding = EncodingInfo{};
+    for (auto chunk = 0; chunk < chunk_count; chunk++) {
+        const auto &scan = scans[chunk];
+        const auto begin = chunk * chunk_size;
+        merged_line_starts.insert(merged_line_starts.end(), scan.line_starts.begin(), scan.line_starts.end());
+        merged_encoding.ascii = merged_encoding.ascii && scan.ascii;
+        merged_encoding.valid_utf8 = merged_encoding.valid_utf8 && scan.valid_utf8;
+        merged_encoding.crlf_count += scan.crlf_count;
+        if (chunk == 0) {
+            merged_encoding.valid_utf8 = merged_encoding.valid_utf8 && scan.leading_continuations == 0;
+            continue;
+        }
+        const auto &previous = scans[chunk - 1];
+        if (destination[begin - 1] == '\r' && destination[begin] == '\n') merged_encoding.crlf_count++;
+        if (previous.cut_sequence >= 0) {
+            const auto length = utf8_sequence(bytes + previous.cut_sequence, size - previous.cut_sequence);
+            merged_encoding.valid_utf8 = merged_encoding.valid_utf8 && length > 0 && previous.cut_sequence + length == begin + scan.leading_continuations;
+        } else {
+            merged_encoding.valid_utf8 = merged_encoding.valid_utf8 && scan.leading_continuations == 0;
+        }
+    }
+    if (chunk_count > 0 && scans.back().cut_sequence >= 0) merged_encoding.valid_utf8 = false;
+}
+
+LoadError FileLoader::error() const {
+    std::lock_guard lock{mutex};
+    return load_error;
+}
+
+int FileLoader::total_size() const {
+    return size;
+}
+
+int FileLoader::loaded_size() const {
+    return loaded.load(std::memory_order_acquire);
+}
+
+std::string_view FileLoader::loaded_text() const {
+    return {destination, static_cast<std::size_t>(loaded_size())};
+}
+
+int FileLoader::wait_for(int bytes) const {
+    std::unique_lock lock{mutex};
+    progress.wait(lock, [&] { return loaded >= bytes || read_done; });
+    return loaded;
+}
+
+std::optional<int> FileLoader::find(std::string_view search, int from) const {
+    const auto text_so_far = loaded_text();
+    const auto pos = text_so_far.find(search, from);
+    if (pos == std::string_view::npos) return {};
+    return static_cast<int>(pos);
+}
+
+bool FileLoader::finish() {
+    if (finished) return error() == LoadError::None;
+    finished = true;
+    if (reader.joinable()) reader.join();
+    for (auto &worker : workers) worker.join();
+    if (error() != LoadError::None) return false;
+
+    merge_scans();
+    scans.clear();
+    buffer->commit_append(size);
+    if (text) {
+        const auto lines_before = text->line_index.line_count();
+        text->line_index.assign(merged_line_starts);
+        text->record_reload(0, lines_before);
+    }
+    return true;
+}
+
+const std::vector<int> &FileLoader::line_starts() const {
+    return merged_line_starts;
+}
+
+const EncodingInfo &FileLoader::encoding() const {
+    return merged_encoding;
+}
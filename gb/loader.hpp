@@ -0,0 +1,103 @@
+//
+// Created by 46769 on 2021-02-13.
+//
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class GapBuffer;
+class Text;
+
+/// What the loader found out about the encoding of a file, while indexing it
+struct EncodingInfo {
+    bool ascii{true};
+    bool valid_utf8{true};
+    /// Number of "\r\n" line endings
+    int crlf_count{0};
+};
+
+enum class LoadError { None, OpenFailed, TooLarge, ReadFailed };
+
+/// Loads a file into a GapBuffer (or Text) in the background. One thread reads the file in large chunks straight into the buffer's pre-sized gap,
+/// while worker threads pick up each chunk as soon as it has been read, to find its line starts & check its encoding. Constructing the loader
+/// only allocates, so the start of the file can be shown & searched through loaded_text() right away, whatever the size of the file.
+/// The buffer must not be touched until finish() has returned
+class FileLoader {
+public:
+    static constexpr int DefaultChunkSize = 4 * 1024 * 1024;
+
+    /// worker_count 0 means one worker per hardware thread, besides the reading thread
+    FileLoader(const std::filesystem::path &path, GapBuffer &buffer, int chunk_size = DefaultChunkSize, int worker_count = 0);
+    /// Like the above, and finish() also hands the line starts to the Text's line index
+    FileLoader(const std::filesystem::path &path, Text &text, int chunk_size = DefaultChunkSize, int worker_count = 0);
+    FileLoader(const FileLoader &) = delete;
+    FileLoader &operator=(const FileLoader &) = delete;
+    /// Stops reading & waits for the background threads. The text isn't committed to the buffer if finish() wasn't called
+    ~FileLoader();
+
+    LoadError error() const;
+    int total_size() const;
+    /// Number of bytes read so far
+    int loaded_size() const;
+    /// The part of the file read so far. The view stays valid until finish() is called
+    std::string_view loaded_text() const;
+    /// Blocks until at least bytes have been read, or reading has stopped. Returns the number of bytes read
+    int wait_for(int bytes) const;
+    /// Searches the part of the file read so far
+    std::optional<int> find(std::string_view search, int from = 0) const;
+
+    /// Waits for the read & the indexing to finish, and commits the text to the buffer. Returns false if the file couldn't be read,
+    /// in which case the buffer is left empty
+    bool finish();
+    /// Valid once finish() has returned true
+    const std::vector<int> &line_starts() const;
+    const EncodingInfo &encoding() const;
+
+private:
+    struct ChunkScan {
+        std::vector<int> line_starts;
+        bool ascii{true};
+        bool valid_utf8{true};
+        int crlf_count{0};
+        /// Continuation bytes at the start of the chunk, which belong to a sequence begun in the chunk before
+        int leading_continuations{0};
+        /// Start of a sequence cut off by the end of the chunk, or -1
+        int cut_sequence{-1};
+    };
+
+    void start(const std::filesystem::path &path, int worker_count);
+    void read_file(std::filesystem::path path);
+    void index_chunks();
+    void scan_chunk(int chunk);
+    /// Combines the per-chunk results, checking the sequences & line endings that straddle chunk boundaries
+    void merge_scans();
+
+    GapBuffer *buffer;
+    Text *text{nullptr};
+    char *destination{nullptr};
+    int size{0};
+    int chunk_size;
+    int chunk_count{0};
+    std::vector<ChunkScan> scans;
+    std::vector<int> merged_line_starts;
+    EncodingInfo merged_encoding;
+    LoadError load_error{LoadError::None};
+    bool finished{false};
+
+    std::atomic<int> loaded{0};
+    std::atomic<int> next_chunk{0};
+    std::atomic<bool> cancelled{false};
+    /// Set by the reading thread once it's done, successfully or not
+    bool read_done{false};
+    mutable std::mutex mutex;
+    mutable std::condition_variable progress;
+    std::thread reader;
+    std::vector<std::thread> workers;
+};
@@ -0,0 +1,131 @@
+//
+// Created by 46769 on 2021-02-16.
+//
+
+#include "lz4.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace lz4 {
+    namespace {
+        constexpr int MinMatch = 4;
+        /// The last match must start at least this far from the end of the input, and the last 5 bytes are always literals
+        constexpr int MatchFindLimit = 12;
+        constexpr int LastLiterals = 5;
+        constexpr int MaxOffset = 65535;
+        constexpr int HashLog = 14;
+
+        std::uint32_t read32(const unsigned char *p) {
+            std::uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        std::uint32_t hash(std::uint32_t sequence) {
+            return (sequence * 2654435761u) >> (32 - HashLog);
+        }
+
+        void write_length(std::vector<char> &out, int length) {
+            for (; length >= 255; length -= 255) out.push_back(static_cast<char>(255));
+            out.push_back(static_cast<char>(length));
+        }
+
+        void write_sequence(std::vector<char> &out, const unsigned char *literals, int literal_length, int offset, int match_length) {
+            const auto match_code = match_length - MinMatch;
+            const auto token = (std::min(literal_length, 15) << 4) | (offset == 0 ? 0 : std::min(match_code, 15));
+            out.push_back(static_cast<char>(token));
+            if (literal_length >= 15) write_length(out, literal_length - 15);
+            out.insert(out.end(), literals, literals + literal_length);
+            // offset 0 marks the last sequence, which only has literals
+            if (offset == 0) return;
+            out.push_back(static_cast<char>(offset & 0xff));
+            out.push_back(static_cast<char>(offset >> 8));
+            if (match_code >= 15) write_length(out, match_code - 15);
+        }
+    }// namespace
+
+    void compress(std::span<const char> input, std::vector<char> &out) {
+        out.clear();
+        out.reserve(input.size() / 2);
+        const auto begin = reinterpret_cast<const unsigned char *>(input.data());
+        const auto length = static_cast<int>(input.size());
+        auto anchor = 0;
+        if (length > MatchFindLimit) {
+            std::vector<int> table(1 << HashLog, -1);
+            const auto match_find_limit = length - MatchFindLimit;
+            const auto match_limit = length - LastLiterals;
+            for (auto pos = 0; pos < match_find_limit;) {
+                const auto sequence = read32(begin + pos);
+                auto &slot = table[hash(sequence)];
+                const auto candidate = slot;
+                slot = pos;
+                if (candidate < 0 || pos - candidate > MaxOffset || read32(begin + candidate) != sequence) {
+                    // skip ahead faster the longer nothing has matched, like LZ4 does, so incompressible data is passed over quickly
+                    pos += 1 + ((pos - anchor) >> 6);
+                    continue;
+                }
+                auto match_length = MinMatch;
+                while (pos + match_length < match_limit && begin[pos + match_length] == begin[candidate + match_length]) match_length++;
+                write_sequence(out, begin + anchor, pos - anchor, pos - candidate, match_length);
+                pos += match_length;
+                anchor = pos;
+            }
+        }
+        write_sequence(out, begin + anchor, length - anchor, 0, 0);
+    }
+
+    bool decompress(std::span<const char> input, std::span<char> output) {
+        auto ip = reinterpret_cast<const unsigned char *>(input.data());
+        const auto input_end = ip + input.size();
+        auto op = output.data();
+        const auto output_begin = output.data(), output_end = output.data() + output.size();
+        const auto read_length = [&ip, input_end](std::size_t &length) {
+            for (;;) {
+                if (ip >= input_end) return false;
+                const auto byte = *ip++;
+                length += byte;
+                if (byte != 255) return true;
+            }
+        };
+        while (ip < input_end) {
+            const auto token = *ip++;
+            std::size_t literal_length = token >> 4;
+            if (literal_length == 15 && !read_length(literal_length)) return false;
+            if (literal_length > static_cast<std::size_t>(input_end - ip) || literal_length > static_cast<std::size_t>(output_end - op)) return false;
+            if (literal_length <= 16 && input_end - ip >= 16 && output_end - op >= 16) {
+                // short runs are the common case; a fixed size copy is a couple of moves, instead of a call into memcpy
+                std::memcpy(op, ip, 16);
+            } else {
+                std::memcpy(op, ip, literal_length);
+            }
+            op += literal_length;
+            ip += literal_length;
+            if (ip == input_end) break;
+
+            if (input_end - ip < 2) return false;
+            const auto offset = static_cast<std::size_t>(ip[0] | (ip[1] << 8));
+            ip += 2;
+            std::size_t match_length = token & 15;
+            if (match_length == 15 && !read_length(match_length)) return false;
+            match_length += MinMatch;
+            if (offset == 0 || offset > static_cast<std::size_t>(op - output_begin) || match_length > static_cast<std::size_t>(output_end - op)) return false;
+            const auto match = op - offset;
+            if (offset >= 16 && match_length <= 16 && output_end - op >= 16) {
+                std::memcpy(op, match, 16);
+            } else if (offset >= match_length) {
+                std::memcpy(op, match, match_length);
+            } else if (offset >= 8) {
+                // overlapping, but 8 bytes at a time never read what they write
+                std::size_t i = 0;
+                for (; i + 8 <= match_length; i += 8) std::memcpy(op + i, match + i, 8);
+                for (; i < match_length; i++) op[i] = match[i];
+            } else {
+                // overlapping match, i.e. a repeating pattern, copied forward byte by byte
+                for (std::size_t i = 0; i < match_length; i++) op[i] = match[i];
+            }
+            op += match_length;
+        }
+        return op == output_end;
+    }
+}// namespace lz4
@@ -0,0 +1,16 @@
+//
+// Created by 46769 on 2021-02-16.
+//
+
+#pragma once
+#include <span>
+#include <vector>
+
+/// A small, self-contained codec for the LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md), used to compress cold
+/// chunks of large buffers. Greedy single-probe matching, like LZ4's fast mode: it favours speed over ratio, which suits text well enough
+namespace lz4 {
+    /// Compresses input into out, which is resized to the compressed size
+    void compress(std::span<const char> input, std::vector<char> &out);
+    /// Decompresses a block into output, which must be exactly the size of the original input. Returns false if the block is malformed
+    bool decompress(std::span<const char> input, std::span<char> output);
+}// namespace lz4
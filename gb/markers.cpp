@@ -0,0 +1,158 @@
+//
+// Created by 46769 on 2021-02-12.
+//
+
+#include "markers.hpp"
+#include <algorithm>
+#include <cassert>
+
+void MarkerSet::DeltaTree::reset(int slots) {
+    tree.assign(slots + 1, 0);
+}
+
+void MarkerSet::DeltaTree::add(int slot, int delta) {
+    for (auto i = slot + 1; i < static_cast<int>(tree.size()); i += i & -i) tree[i] += delta;
+}
+
+int MarkerSet::DeltaTree::prefix(int slot) const {
+    auto sum = 0;
+    for (auto i = slot + 1; i > 0; i -= i & -i) sum += tree[i];
+    return sum;
+}
+
+void MarkerSet::DeltaTree::materialize(std::vector<int> &out) const {
+    // undo the tree construction to get the plain per-slot deltas back, then sum them up
+    out.assign(tree.begin(), tree.end());
+    const auto n = static_cast<int>(out.size()) - 1;
+    for (auto i = n; i > 0; i--) {
+        if (const auto parent = i + (i & -i); parent <= n) out[parent] -= out[i];
+    }
+    for (auto i = 1; i <= n; i++) out[i] += out[i - 1];
+    out.erase(out.begin());
+}
+
+MarkerSet::MarkerSet(MarkerGravity gravity) : gravity(gravity) {}
+
+MarkerSet::Marker MarkerSet::add(int pos) {
+    const auto marker = static_cast<Marker>(marker_slot.size());
+    marker_slot.push_back(Staged);
+    const auto it = std::upper_bound(staged.begin(), staged.end(), pos, [](int p, const MarkerPosition &m) { return p < m.pos; });
+    staged.insert(it, {marker, pos});
+    live++;
+    // staged markers cost O(staged) per edit, so they're merged once there's enough of them to pay for the O(n) merge
+    if (static_cast<int>(staged.size()) > 512) merge_staged();
+    return marker;
+}
+
+void MarkerSet::remove(Marker marker) {
+    assert(contains(marker));
+    if (marker_slot[marker] == Staged) {
+        std::erase_if(staged, [marker](const MarkerPosition &m) { return m.marker == marker; });
+    } else {
+        slot_marker[marker_slot[marker]] = Removed;
+        if (++removed_slots > static_cast<int>(slot_marker.size()) / 2) merge_staged();
+    }
+    marker_slot[marker] = Removed;
+    live--;
+}
+
+bool MarkerSet::contains(Marker marker) const {
+    return marker >= 0 && marker < static_cast<int>(marker_slot.size()) && marker_slot[marker] != Removed;
+}
+
+int MarkerSet::position(Marker marker) const {
+    assert(contains(marker));
+    if (marker_slot[marker] != Staged) return slot_position(marker_slot[marker]);
+    return std::find_if(staged.begin(), staged.end(), [marker](const MarkerPosition &m) { return m.marker == marker; })->pos;
+}
+
+int MarkerSet::size() const {
+    return live;
+}
+
+void MarkerSet::clear() {
+    base.clear();
+    slot_marker.clear();
+    deltas.reset(0);
+    staged.clear();
+    marker_slot.clear();
+    removed_slots = 0;
+    live = 0;
+}
+
+std::vector<MarkerPosition> MarkerSet::in_range(int begin, int end) const {
+    std::vector<MarkerPosition> result;
+    for (auto slot = first_slot_at(begin), last = first_slot_at(end); slot < last; slot++) {
+        if (slot_marker[slot] != Removed) result.push_back({slot_marker[slot], slot_position(slot)});
+    }
+    const auto middle = static_cast<std::ptrdiff_t>(result.size());
+    const auto by_pos = [](const MarkerPosition &m, int pos) { return m.pos < pos; };
+    for (auto it = std::lower_bound(staged.begin(), staged.end(), begin, by_pos); it != staged.end() && it->pos < end; ++it) result.push_back(*it);
+    std::inplace_merge(result.begin(), result.begin() + middle, result.end(), [](const MarkerPosition &a, const MarkerPosition &b) { return a.pos < b.pos; });
+    return result;
+}
+
+void MarkerSet::on_change(const ChangeEvent &event) {
+    const auto offset = event.offset;
+    if (event.removed > 0) {
+        const auto erased_end = offset + event.removed;
+        // markers inside the erased text collapse onto the erase point, everything after it moves back
+        const auto first = first_slot_at(offset + 1), last = first_slot_at(erased_end);
+        for (auto slot = first; slot < last; slot++) {
+            const auto shift = offset - slot_position(slot);
+            deltas.add(slot, shift);
+            deltas.add(slot + 1, -shift);
+        }
+        deltas.add(last, -event.removed);
+        for (auto &m : staged) m.pos = m.pos >= erased_end ? m.pos - event.removed : std::min(m.pos, offset);
+    }
+    if (event.inserted > 0) {
+        const auto moves = [this, offset](int pos) { return gravity == MarkerGravity::Left ? pos > offset : pos >= offset; };
+        deltas.add(first_slot_at(gravity == MarkerGravity::Left ? offset + 1 : offset), event.inserted);
+        for (auto &m : staged) {
+            if (moves(m.pos)) m.pos += event.inserted;
+        }
+    }
+}
+
+int MarkerSet::slot_position(int slot) const {
+    return base[slot] + deltas.prefix(slot);
+}
+
+int MarkerSet::first_slot_at(int pos) const {
+    // positions are non-decreasing over the slots, edits never reorder markers
+    auto lo = 0, hi = static_cast<int>(base.size());
+    while (lo < hi) {
+        const auto mid = lo + (hi - lo) / 2;
+        if (slot_position(mid) < pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void MarkerSet::merge_staged() {
+    std::vector<int> shifts;
+    deltas.materialize(shifts);
+    std::vector<MarkerPosition> merged;
+    merged.reserve(live);
+    for (auto slot = 0; slot < static_cast<int>(base.size()); slot++) {
+        if (slot_marker[slot] != Removed) merged.push_back({slot_marker[slot], base[slot] + shifts[slot]});
+    }
+    const auto middle = static_cast<std::ptrdiff_t>(merged.size());
+    merged.insert(merged.end(), staged.begin(), staged.end());
+    std::inplace_merge(merged.begin(), merged.begin() + middle, merged.end(), [](const MarkerPosition &a, const MarkerPosition &b) { return a.pos < b.pos; });
+
+    base.resize(merged.size());
+    slot_marker.resize(merged.size());
+    for (auto slot = 0; slot < static_cast<int>(merged.size()); slot++) {
+        base[slot] = merged[slot].pos;
+        slot_marker[slot] = merged[slot].marker;
+        marker_slot[merged[slot].marker] = slot;
+    }
+    deltas.reset(static_cast<int>(merged.size()));
+    staged.clear();
+    removed_slots = 0;
+}
@@ -0,0 +1,72 @@
+//
+// Created by 46769 on 2021-02-12.
+//
+
+#pragma once
+#include "changes.hpp"
+#include <vector>
+
+/// Decides where a marker sitting exactly at an insertion point ends up. Left keeps it in front of the inserted text, Right moves it past it (like a cursor)
+enum class MarkerGravity { Left, Right };
+
+struct MarkerPosition {
+    int marker;
+    int pos;
+};
+
+/// Text positions (diagnostics, bookmarks, search hits, cursors) that follow the text as it is edited. Markers are kept sorted by position, and
+/// positions are stored as a base plus a Fenwick tree of deltas, so an edit shifts every marker after it with one O(log n) update instead of
+/// touching each of them. Only markers inside erased text are visited individually, as they collapse onto the erase point.
+/// Newly added markers are staged in a small sorted list, and merged into the tree in one O(n) pass once enough of them have piled up
+class MarkerSet {
+public:
+    using Marker = int;
+
+    explicit MarkerSet(MarkerGravity gravity = MarkerGravity::Left);
+
+    Marker add(int pos);
+    void remove(Marker marker);
+    bool contains(Marker marker) const;
+    /// Returns the current position of marker, which must not have been removed
+    int position(Marker marker) const;
+    int size() const;
+    void clear();
+    /// Returns the markers in text positions [begin, end), ordered by position
+    std::vector<MarkerPosition> in_range(int begin, int end) const;
+    /// Moves the markers to where the text they were at ended up after the edit
+    void on_change(const ChangeEvent &event);
+
+private:
+    /// Fenwick tree over slots. add(slot, d) shifts slot & every slot after it by d, prefix(slot) sums up the shifts of a slot
+    class DeltaTree {
+    public:
+        void reset(int slots);
+        void add(int slot, int delta);
+        int prefix(int slot) const;
+        /// Writes the summed up shifts of every slot to out, in O(n)
+        void materialize(std::vector<int> &out) const;
+
+    private:
+        std::vector<int> tree{0};
+    };
+
+    static constexpr Marker Staged = -1;
+    static constexpr Marker Removed = -2;
+
+    int slot_position(int slot) const;
+    /// Returns the first slot with a position of at least pos
+    int first_slot_at(int pos) const;
+    void merge_staged();
+
+    MarkerGravity gravity;
+    /// Sorted markers. slot_marker is Removed for markers removed since the last merge, which keep their slot (& position) until then
+    std::vector<int> base;
+    std::vector<Marker> slot_marker;
+    DeltaTree deltas;
+    /// Recently added markers, sorted by position & updated directly
+    std::vector<MarkerPosition> staged;
+    /// marker -> slot, or Staged / Removed
+    std::vector<int> marker_slot;
+    int removed_slots{0};
+    int live{0};
+};
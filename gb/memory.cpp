@@ -0,0 +1,158 @@
+//
+// Created by 46769 on 2021-02-05.
+//
+
+#include "memory.hpp"
+#include <cstdint>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vmem {
+    std::size_t page_size() {
+#if defined(_WIN32)
+        static const auto size = [] {
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            return static_cast<std::size_t>(info.dwPageSize);
+        }();
+        return size;
+#elif defined(__unix__) || defined(__APPLE__)
+        static const auto size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        return size;
+#else
+        return 4096;
+#endif
+    }
+
+    static std::size_t round_to_pages(std::size_t size) {
+        const auto page = page_size();
+        return (size + page - 1) & ~(page - 1);
+    }
+
+    static void advise_huge_pages([[maybe_unused]] char *mapping, [[maybe_unused]] std::size_t size) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        // Only advice, if transparent huge pages are turned off system wide, this fails and we carry on with regular pages
+        madvise(mapping, size, MADV_HUGEPAGE);
+#endif
+    }
+
+    bool can_map() {
+#if defined(_WIN32) || defined(__unix__) || defined(__APPLE__)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    char *map(std::size_t size, [[maybe_unused]] bool huge_pages) {
+        const auto length = round_to_pages(size);
+#if defined(_WIN32)
+        return static_cast<char *>(VirtualAlloc(nullptr, length, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#elif defined(__unix__) || defined(__APPLE__)
+        auto mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) return nullptr;
+        if (huge_pages) advise_huge_pages(static_cast<char *>(mapping), length);
+        return static_cast<char *>(mapping);
+#else
+        return nullptr;
+#endif
+    }
+
+    char *remap([[maybe_unused]] char *mapping, [[maybe_unused]] std::size_t old_size, [[maybe_unused]] std::size_t new_size, [[maybe_unused]] bool huge_pages) {
+#if defined(__linux__)
+        const auto new_length = round_to_pages(new_size);
+        auto result = mremap(mapping, round_to_pages(old_size), new_length, MREMAP_MAYMOVE);
+        if (result == MAP_FAILED) return nullptr;
+        if (huge_pages) advise_huge_pages(static_cast<char *>(result), new_length);
+        return static_cast<char *>(result);
+#else
+        return nullptr;
+#endif
+    }
+
+    void unmap(char *mapping, [[maybe_unused]] std::size_t size) {
+        if (mapping == nullptr) return;
+#if defined(_WIN32)
+        VirtualFree(mapping, 0, MEM_RELEASE);
+#elif defined(__unix__) || defined(__APPLE__)
+        munmap(mapping, round_to_pages(size));
+#endif
+    }
+
+    std::size_t release_pages(char *begin, char *end) {
+        const auto page = page_size();
+        const auto first = (reinterpret_cast<std::uintptr_t>(begin) + page - 1) & ~(page - 1);
+        const auto last = reinterpret_cast<std::uintptr_t>(end) & ~(page - 1);
+        if (first >= last) return 0;
+        const auto length = static_cast<std::size_t>(last - first);
+#if defined(_WIN32)
+        if (VirtualAlloc(reinterpret_cast<void *>(first), length, MEM_RESET, PAGE_READWRITE) == nullptr) return 0;
+        return length;
+#elif defined(__unix__) || defined(__APPLE__)
+        if (madvise(reinterpret_cast<void *>(first), length, MADV_DONTNEED) != 0) return 0;
+        return length;
+#else
+        return 0;
+#endif
+    }
+
+    std::optional<MappedFile> MappedFile::open(const std::filesystem::path &path) {
+#if defined(_WIN32)
+        auto file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return {};
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            CloseHandle(file);
+            return {};
+        }
+        auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr) return {};
+        auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == nullptr) {
+            CloseHandle(mapping);
+            return {};
+        }
+        return MappedFile{static_cast<const char *>(view), static_cast<std::size_t>(size.QuadPart), mapping};
+#elif defined(__unix__) || defined(__APPLE__)
+        auto fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return {};
+        struct stat info {};
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            close(fd);
+            return {};
+        }
+        auto view = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (view == MAP_FAILED) return {};
+        return MappedFile{static_cast<const char *>(view), static_cast<std::size_t>(info.st_size), nullptr};
+#else
+        return {};
+#endif
+    }
+
+    MappedFile::MappedFile(MappedFile &&other) noexcept : m_data(other.m_data), m_size(other.m_size), m_handle(other.m_handle) {
+        other.m_data = nullptr;
+        other.m_size = 0;
+        other.m_handle = nullptr;
+    }
+
+    MappedFile::~MappedFile() {
+        if (m_data == nullptr) return;
+#if defined(_WIN32)
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_handle);
+#elif defined(__unix__) || defined(__APPLE__)
+        munmap(const_cast<char *>(m_data), m_size);
+#endif
+    }
+}// namespace vmem
@@ -0,0 +1,50 @@
+//
+// Created by 46769 on 2021-02-05.
+//
+
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+/// Thin platform layer for the virtual memory operations the GapBuffer uses for large buffers, and to hand memory back to the OS
+namespace vmem {
+    /// Returns the size of a virtual memory page
+    std::size_t page_size();
+
+    /// Returns true if this platform can back buffers directly with virtual memory mappings
+    bool can_map();
+    /// Maps size bytes (rounded up to whole pages) of zeroed, read/write memory. If huge_pages is set, the OS is asked to back the mapping with
+    /// transparent huge pages where it supports that. Returns nullptr on failure
+    char *map(std::size_t size, bool huge_pages);
+    /// Grows or shrinks a mapping returned by map(), by relocating page table entries instead of copying, so the mapping may move.
+    /// Returns nullptr if that failed or isn't supported on this platform (anything but Linux), in which case the old mapping is still valid
+    char *remap(char *mapping, std::size_t old_size, std::size_t new_size, bool huge_pages);
+    /// Unmaps a mapping returned by map() or remap()
+    void unmap(char *mapping, std::size_t size);
+
+    /// Tells the OS the contents of the whole pages inside [begin, end) are no longer needed, so that they stop counting towards resident memory.
+    /// The range stays valid to write to, the pages are faulted back in (zeroed) on next touch. Partial pages at either end are left alone.
+    /// Returns the number of bytes released
+    std::size_t release_pages(char *begin, char *end);
+
+    /// A whole file, mapped read-only into memory. Unmapped when destroyed
+    class MappedFile {
+    public:
+        static std::optional<MappedFile> open(const std::filesystem::path &path);
+        MappedFile(MappedFile &&other) noexcept;
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+        ~MappedFile();
+
+        std::span<const char> bytes() const { return {m_data, m_size}; }
+
+    private:
+        MappedFile(const char *data, std::size_t size, void *handle) : m_data(data), m_size(size), m_handle(handle) {}
+        const char *m_data;
+        std::size_t m_size;
+        /// The file mapping object on Windows, unused elsewhere
+        void *m_handle;
+    };
+}// namespace vmem
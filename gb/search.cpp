@@ -0,0 +1,197 @@
+//
+// Created by 46769 on 2021-02-18.
+//
+
+#include "search.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <string>
+
+namespace {
+    bool is_ascii(char ch) {
+        return static_cast<unsigned char>(ch) < 0x80;
+    }
+
+    char ascii_lower(char ch) {
+        return ch >= 'A' && ch <= 'Z' ? static_cast<char>(ch + ('a' - 'A')) : ch;
+    }
+
+    char ascii_upper(char ch) {
+        return ch >= 'a' && ch <= 'z' ? static_cast<char>(ch - ('a' - 'A')) : ch;
+    }
+
+    bool is_word_char(char ch) {
+        return !is_ascii(ch) || (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+    }
+
+    /// Decodes the UTF-8 sequence at p. Malformed ones decode as their first byte, of length 1
+    std::pair<char32_t, int> decode(const char *p, int available) {
+        const auto lead = static_cast<unsigned char>(p[0]);
+        const auto length = lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : lead >= 0xc0 ? 2 : 1;
+        if (length == 1 || length > available) return {lead, 1};
+        char32_t cp = lead & (0x7f >> length);
+        for (auto i = 1; i < length; i++) {
+            const auto ch = static_cast<unsigned char>(p[i]);
+            if ((ch & 0xc0) != 0x80) return {lead, 1};
+            cp = (cp << 6) | (ch & 0x3f);
+        }
+        return {cp, length};
+    }
+
+    /// Simple case folding, limited to letters whose folded form has the same UTF-8 length, so that a match is as long as the needle
+    char32_t fold_case(char32_t cp) {
+        if (cp < 0x80) return static_cast<char32_t>(ascii_lower(static_cast<char>(cp)));
+        if (cp == 0xb5) return 0x3bc;// micro sign -> mu
+        if (cp >= 0xc0 && cp <= 0xde && cp != 0xd7) return cp + 0x20;
+        if (cp >= 0x100 && cp <= 0x17f) {
+            // Latin Extended-A comes in upper/lower pairs, except for a few ranges where they're shifted by one
+            if (cp == 0x130 || cp == 0x131 || cp == 0x138 || cp == 0x149 || cp == 0x17f) return cp;
+            if (cp == 0x178) return 0xff;
+            const auto odd_upper = (cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17e);
+            return odd_upper ? cp + (cp % 2) : cp + 1 - (cp % 2);
+        }
+        if (cp >= 0x391 && cp <= 0x3a9 && cp != 0x3a2) return cp + 0x20;
+        if (cp == 0x3c2) return 0x3c3;// final sigma
+        if (cp >= 0x410 && cp <= 0x42f) return cp + 0x20;
+        if (cp >= 0x400 && cp <= 0x40f) return cp + 0x50;
+        return cp;
+    }
+
+    class Matcher {
+    public:
+        Matcher(std::string_view needle, SearchOptions options) : needle(needle), length(static_cast<int>(needle.size())), case_insensitive(options.case_insensitive) {
+            ascii = std::all_of(needle.begin(), needle.end(), is_ascii);
+            if (case_insensitive && ascii) std::transform(this->needle.begin(), this->needle.end(), this->needle.begin(), ascii_lower);
+            // candidates are filtered on the first & last byte, or for folded UTF-8, on the first & last ASCII byte, which folding keeps in place
+            auto first = 0, last = length - 1;
+            if (case_insensitive && !ascii) {
+                while (first < length && !is_ascii(needle[first])) first++;
+                while (last >= 0 && !is_ascii(needle[last])) last--;
+            }
+            filtered = first < length;
+            if (!filtered) return;
+            probes = {first, last};
+            for (auto i = 0; i < 2; i++) {
+                const auto ch = needle[probes[i]];
+                variants[i] = case_insensitive ? std::array{ascii_lower(ch), ascii_upper(ch)} : std::array{ch, ch};
+            }
+        }
+
+        /// Whether the length characters at text match the needle
+        bool matches(const char *text) const {
+            if (!case_insensitive) return std::memcmp(text, needle.data(), length) == 0;
+            if (ascii) {
+                for (auto i = 0; i < length; i++) {
+                    if (ascii_lower(text[i]) != needle[i]) return false;
+                }
+                return true;
+            }
+            for (auto i = 0; i < length;) {
+                const auto [expected, expected_length] = decode(needle.data() + i, length - i);
+                const auto [actual, actual_length] = decode(text + i, length - i);
+                if (actual_length != expected_length || fold_case(actual) != fold_case(expected)) return false;
+                i += actual_length;
+            }
+            return true;
+        }
+
+        /// Returns the first i where text[i, i + length) matches & accept(i) holds
+        template<typename Accept>
+        std::optional<int> scan(std::span<const char> text, Accept accept) const {
+            const auto end = static_cast<int>(text.size()) - length + 1;// one past the last possible match
+            const auto p = text.data();
+            auto i = 0;
+            if (filtered) {
+                const auto [a, b] = probes;
+#ifdef INTRINSICS
+                const auto a0 = _mm256_set1_epi8(variants[0][0]), a1 = _mm256_set1_epi8(variants[0][1]);
+                const auto b0 = _mm256_set1_epi8(variants[1][0]), b1 = _mm256_set1_epi8(variants[1][1]);
+                for (; i + 32 <= end; i += 32) {
+                    const auto va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i + a));
+                    const auto vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i + b));
+                    const auto hits = _mm256_and_si256(_mm256_or_si256(_mm256_cmpeq_epi8(va, a0), _mm256_cmpeq_epi8(va, a1)),
+                                                       _mm256_or_si256(_mm256_cmpeq_epi8(vb, b0), _mm256_cmpeq_epi8(vb, b1)));
+                    for (auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(hits)); mask != 0; mask &= mask - 1) {
+                        const auto candidate = i + std::countr_zero(mask);
+                        if (matches(p + candidate) && accept(candidate)) return candidate;
+                    }
+                }
+#endif
+                for (; i + 8 <= end; i += 8) {
+                    const auto va = simd::load64(p + i + a), vb = simd::load64(p + i + b);
+                    auto hits = (simd::equal_bytes(va, variants[0][0]) | simd::equal_bytes(va, variants[0][1])) &
+                                (simd::equal_bytes(vb, variants[1][0]) | simd::equal_bytes(vb, variants[1][1]));
+                    for (; hits != 0; hits &= hits - 1) {
+                        const auto candidate = i + std::countr_zero(hits) / 8;
+                        if (matches(p + candidate) && accept(candidate)) return candidate;
+                    }
+                }
+            }
+            for (; i < end; i++) {
+                if (matches(p + i) && accept(i)) return i;
+            }
+            return {};
+        }
+
+        int size() const {
+            return length;
+        }
+
+    private:
+        /// Lowercased, when searching case insensitively for an ASCII needle
+        std::string needle;
+        int length;
+        bool case_insensitive;
+        bool ascii;
+        bool filtered;
+        std::array<int, 2> probes{};
+        std::array<std::array<char, 2>, 2> variants{};
+    };
+}// namespace
+
+std::optional<int> search_segments(const GapBuffer &buffer, std::string_view needle, int from, SearchOptions options) {
+    const auto size = buffer.size();
+    from = std::max(from, 0);
+    if (needle.empty() || from + static_cast<int>(needle.size()) > size) return {};
+    const Matcher matcher{needle, options};
+    const auto length = matcher.size();
+    auto accept = [&](int pos) {
+        if (!options.whole_word) return true;
+        return (pos == 0 || !is_word_char(buffer.get_at(pos - 1))) && (pos + length == size || !is_word_char(buffer.get_at(pos + length)));
+    };
+
+    std::optional<int> found;
+    // the last (up to) length - 1 characters before offset, for the matches that start in one segment & end in a later one
+    std::string carry;
+    auto offset = from;
+    buffer.for_each_segment(from, size, [&](std::span<const char> segment) {
+        const auto segment_size = static_cast<int>(segment.size());
+        const auto carried = static_cast<int>(carry.size());
+        if (carried > 0) {
+            auto window = carry;
+            window.append(segment.data(), std::min(segment_size, length - 1));
+            for (auto i = 0; i < carried && i + length <= static_cast<int>(window.size()); i++) {
+                if (matcher.matches(window.data() + i) && accept(offset - carried + i)) {
+                    found = offset - carried + i;
+                    return false;
+                }
+            }
+        }
+        if (const auto hit = matcher.scan(segment, [&](int i) { return accept(offset + i); })) {
+            found = offset + *hit;
+            return false;
+        }
+        if (segment_size >= length - 1) {
+            carry.assign(segment.data() + segment_size - (length - 1), length - 1);
+        } else {
+            carry.append(segment.data(), segment_size);
+            if (static_cast<int>(carry.size()) > length - 1) carry.erase(0, carry.size() - (length - 1));
+        }
+        offset += segment_size;
+        return true;
+    });
+    return found;
+}
@@ -0,0 +1,14 @@
+//
+// Created by 46769 on 2021-02-18.
+//
+
+#pragma once
+#include "gap_buffer.hpp"
+#include <optional>
+#include <string_view>
+
+/// Finds the first match of needle in buffer at or after from, with options applied on the fly. The text is scanned segment by segment
+/// without being copied: candidate positions are picked out by comparing two of the needle's bytes (in either case) against 32 (AVX2) or
+/// 8 (general purpose registers) positions at once, and only those are checked in full. Matches that straddle two segments are checked
+/// in a window of at most 2 * needle.size() characters around the seam. An empty needle never matches
+std::optional<int> search_segments(const GapBuffer &buffer, std::string_view needle, int from, SearchOptions options);
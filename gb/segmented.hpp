@@ -0,0 +1,107 @@
+//
+// Created by 46769 on 2021-02-03.
+//
+
+#pragma once
+#include "gap_buffer.hpp"
+#include <algorithm>
+#include <cstring>
+#include <span>
+
+/// Segment-aware versions of the standard algorithms, for GapBuffer iterators. Instead of paying for the gap check on every dereference,
+/// these ask the buffer for the contiguous runs of text in [first, last) and run the standard algorithm as a tight loop over each run.
+/// They take the same arguments & return the same things as their std:: counterparts.
+namespace segmented {
+
+    template<bool Const, typename OutIt>
+    OutIt copy(GapBufferIterator<Const> first, GapBufferIterator<Const> last, OutIt out) {
+        first.buffer()->for_each_segment(first.index(), last.index(), [&out](auto segment) {
+            out = std::copy(segment.begin(), segment.end(), out);
+        });
+        return out;
+    }
+
+    template<bool Const>
+    GapBufferIterator<Const> find(GapBufferIterator<Const> first, GapBufferIterator<Const> last, char value) {
+        auto offset = first.index();
+        auto found = false;
+        first.buffer()->for_each_segment(first.index(), last.index(), [&](auto segment) {
+            auto it = std::find(segment.begin(), segment.end(), value);
+            offset += static_cast<int>(std::distance(segment.begin(), it));
+            found = it != segment.end();
+            return !found;
+        });
+        return found ? GapBufferIterator<Const>{first.buffer(), offset} : last;
+    }
+
+    template<bool Const, typename Predicate>
+    GapBufferIterator<Const> find_if(GapBufferIterator<Const> first, GapBufferIterator<Const> last, Predicate pred) {
+        auto offset = first.index();
+        auto found = false;
+        first.buffer()->for_each_segment(first.index(), last.index(), [&](auto segment) {
+            auto it = std::find_if(segment.begin(), segment.end(), pred);
+            offset += static_cast<int>(std::distance(segment.begin(), it));
+            found = it != segment.end();
+            return !found;
+        });
+        return found ? GapBufferIterator<Const>{first.buffer(), offset} : last;
+    }
+
+    template<bool Const>
+    std::ptrdiff_t count(GapBufferIterator<Const> first, GapBufferIterator<Const> last, char value) {
+        std::ptrdiff_t result = 0;
+        first.buffer()->for_each_segment(first.index(), last.index(), [&](auto segment) {
+            result += std::count(segment.begin(), segment.end(), value);
+        });
+        return result;
+    }
+
+    template<bool Const, typename Predicate>
+    std::ptrdiff_t count_if(GapBufferIterator<Const> first, GapBufferIterator<Const> last, Predicate pred) {
+        std::ptrdiff_t result = 0;
+        first.buffer()->for_each_segment(first.index(), last.index(), [&](auto segment) {
+            result += std::count_if(segment.begin(), segment.end(), pred);
+        });
+        return result;
+    }
+
+    /// Output may be the input range itself (i.e. an in-place transform), same as std::transform
+    template<bool Const, typename OutIt, typename UnaryOp>
+    OutIt transform(GapBufferIterator<Const> first, GapBufferIterator<Const> last, OutIt out, UnaryOp op) {
+        first.buffer()->for_each_segment(first.index(), last.index(), [&](auto segment) {
+            out = std::transform(segment.begin(), segment.end(), out, op);
+        });
+        return out;
+    }
+
+    template<bool Const, typename InputIt>
+    bool equal(GapBufferIterator<Const> first, GapBufferIterator<Const> last, InputIt first2) {
+        return first.buffer()->for_each_segment(first.index(), last.index(), [&first2](auto segment) {
+            auto result = std::equal(segment.begin(), segment.end(), first2);
+            std::advance(first2, segment.size());
+            return result;
+        });
+    }
+
+    /// Both ranges are segmented, so the segments of the first range are matched up against the segments of the second one, and compared using memcmp
+    template<bool Const, bool Const2>
+    bool equal(GapBufferIterator<Const> first, GapBufferIterator<Const> last, GapBufferIterator<Const2> first2) {
+        auto pos2 = first2.index();
+        return first.buffer()->for_each_segment(first.index(), last.index(), [&](auto segment) {
+            auto lhs = segment.data();
+            auto result = first2.buffer()->for_each_segment(pos2, pos2 + static_cast<int>(segment.size()), [&lhs](auto segment2) {
+                auto match = std::memcmp(lhs, segment2.data(), segment2.size()) == 0;
+                lhs += segment2.size();
+                return match;
+            });
+            pos2 += static_cast<int>(segment.size());
+            return result;
+        });
+    }
+
+    template<bool Const, bool Const2>
+    bool equal(GapBufferIterator<Const> first, GapBufferIterator<Const> last, GapBufferIterator<Const2> first2, GapBufferIterator<Const2> last2) {
+        if (last - first != last2 - first2) return false;
+        return equal(first, last, first2);
+    }
+}// namespace segmented
@@ -0,0 +1,128 @@
+//
+// Created by 46769 on 2021-02-10.
+//
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#ifdef INTRINSICS
+#include <immintrin.h>
+#endif
+
+/// Vectorized helpers. With INTRINSICS defined these use AVX2, otherwise they fall back to comparing 8 bytes at a time in general purpose registers
+namespace simd {
+    inline std::uint64_t load64(const char *p) {
+        std::uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    /// Returns the length of the common prefix of a[0, length) and b[0, length)
+    inline std::size_t common_prefix(const char *a, const char *b, std::size_t length) {
+        std::size_t i = 0;
+#ifdef INTRINSICS
+        for (; i + 32 <= length; i += 32) {
+            const auto va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            const auto vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+            const auto differs = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+            if (differs != 0) return i + std::countr_zero(differs);
+        }
+#endif
+        // little endian: the first differing byte is the lowest differing bit
+        for (; i + 8 <= length; i += 8) {
+            const auto differs = load64(a + i) ^ load64(b + i);
+            if (differs != 0) return i + std::countr_zero(differs) / 8;
+        }
+        for (; i < length && a[i] == b[i]; i++) {}
+        return i;
+    }
+
+    /// Returns the length of the common suffix of [a_end - length, a_end) and [b_end - length, b_end)
+    inline std::size_t common_suffix(const char *a_end, const char *b_end, std::size_t length) {
+        std::size_t i = 0;
+#ifdef INTRINSICS
+        for (; i + 32 <= length; i += 32) {
+            const auto va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a_end - i - 32));
+            const auto vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b_end - i - 32));
+            const auto differs = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+            if (differs != 0) return i + std::countl_zero(differs);
+        }
+#endif
+        for (; i + 8 <= length; i += 8) {
+            const auto differs = load64(a_end - i - 8) ^ load64(b_end - i - 8);
+            if (differs != 0) return i + std::countl_zero(differs) / 8;
+        }
+        for (; i < length && *(a_end - i - 1) == *(b_end - i - 1); i++) {}
+        return i;
+    }
+
+    /// Returns a mask with the high bit set in every byte of v that equals ch, and no other bits set
+    inline std::uint64_t equal_bytes(std::uint64_t v, char ch) {
+        constexpr auto low7 = 0x7f7f7f7f7f7f7f7full;
+        const auto x = v ^ (0x0101010101010101ull * static_cast<unsigned char>(ch));
+        // a byte of x is zero iff adding 0x7f to its low 7 bits doesn't carry into the high bit, and the high bit wasn't set to begin with
+        return ~(((x & low7) + low7) | x) & ~low7;
+    }
+
+    /// Returns how many UTF-16 code units the UTF-8 in the 8 bytes of v take: one per byte that isn't a continuation byte, plus one more per lead byte
+    /// of a 4 byte sequence (a surrogate pair). The count is per byte, so it adds up over any split of a text, wherever the split falls
+    inline int utf16_units(std::uint64_t v) {
+        constexpr auto high = 0x8080808080808080ull;
+        const auto continuation = v & ~(v << 1) & high;
+        const auto four_byte_lead = v & (v << 1) & (v << 2) & (v << 3) & high;
+        return 8 - std::popcount(continuation) + std::popcount(four_byte_lead);
+    }
+
+    /// Returns how many UTF-16 code units the UTF-8 in text takes, see utf16_units(std::uint64_t)
+    inline std::size_t utf16_units(std::span<const char> text) {
+        const auto p = text.data();
+        const auto length = text.size();
+        std::size_t i = 0, units = 0;
+#ifdef INTRINSICS
+        // continuation bytes are 0x80-0xbf, i.e. below -64 as signed bytes, and 4 byte leads are 0xf0-0xff, i.e. -16 to -1
+        const auto below_continuation = _mm256_set1_epi8(-64), below_lead = _mm256_set1_epi8(-17), zero = _mm256_setzero_si256();
+        for (; i + 32 <= length; i += 32) {
+            const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+            const auto continuation = _mm256_cmpgt_epi8(below_continuation, v);
+            const auto four_byte_lead = _mm256_and_si256(_mm256_cmpgt_epi8(v, below_lead), _mm256_cmpgt_epi8(zero, v));
+            units += 32 - std::popcount(static_cast<std::uint32_t>(_mm256_movemask_epi8(continuation))) + std::popcount(static_cast<std::uint32_t>(_mm256_movemask_epi8(four_byte_lead)));
+        }
+#endif
+        for (; i + 8 <= length; i += 8) units += utf16_units(load64(p + i));
+        for (; i < length; i++) {
+            const auto ch = static_cast<unsigned char>(p[i]);
+            units += ((ch & 0xc0) != 0x80) + (ch >= 0xf0);
+        }
+        return units;
+    }
+
+    /// Calls fn(i), in ascending order, for every i where text[i] is one of the characters in set
+    template<std::size_t N, typename Fn>
+    void for_each_of(std::span<const char> text, const std::array<char, N> &set, Fn fn) {
+        const auto p = text.data();
+        const auto length = text.size();
+        std::size_t i = 0;
+#ifdef INTRINSICS
+        for (; i + 32 <= length; i += 32) {
+            const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+            auto any = _mm256_setzero_si256();
+            for (auto ch : set) any = _mm256_or_si256(any, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(ch)));
+            for (auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(any)); mask != 0; mask &= mask - 1) fn(i + std::countr_zero(mask));
+        }
+#endif
+        for (; i + 8 <= length; i += 8) {
+            const auto v = load64(p + i);
+            std::uint64_t any = 0;
+            for (auto ch : set) any |= equal_bytes(v, ch);
+            for (; any != 0; any &= any - 1) fn(i + std::countr_zero(any) / 8);
+        }
+        for (; i < length; i++) {
+            if (std::find(set.begin(), set.end(), p[i]) != set.end()) fn(i);
+        }
+    }
+}// namespace simd
@@ -0,0 +1,255 @@
+//
+// Created by 46769 on 2021-02-08.
+//
+
+#include "snapshot.hpp"
+#include "hash.hpp"
+#include "text.hpp"
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <system_error>
+
+static_assert(sizeof(int) == 4, "line starts are stored, and handed out in place, as 32-bit ints");
+
+static constexpr std::uint32_t fourcc(const char (&tag)[5]) {
+    return static_cast<std::uint32_t>(tag[0]) | static_cast<std::uint32_t>(tag[1]) << 8 | static_cast<std::uint32_t>(tag[2]) << 16 | static_cast<std::uint32_t>(tag[3]) << 24;
+}
+
+// the \r\n & \0 catch the file having gone through text mode conversion somewhere, same trick as PNG's signature
+static constexpr std::array<char, 8> SNAPSHOT_MAGIC{'G', 'B', 'S', 'N', 'A', 'P', '\r', '\n'};
+static constexpr std::uint32_t SNAPSHOT_VERSION = 1;
+static constexpr std::uint32_t SNAPSHOT_ENDIANNESS = 0x01020304;
+static constexpr std::uint64_t SECTION_ALIGNMENT = 64;
+static constexpr std::uint32_t STATE_TAG = fourcc("STAT");
+static constexpr std::uint32_t TEXT_TAG = fourcc("TEXT");
+static constexpr std::uint32_t LINE_TAG = fourcc("LINE");
+
+struct SnapshotHeader {
+    std::array<char, 8> magic;
+    std::uint32_t version;
+    std::uint32_t endianness;
+    std::uint64_t file_size;
+    std::uint64_t source_stamp;
+    std::uint32_t section_count;
+    std::uint32_t reserved;
+    /// xxh64 of the header (with this field zeroed) followed by the section directory
+    std::uint64_t checksum;
+};
+
+struct SnapshotSection {
+    std::uint32_t tag;
+    std::uint32_t reserved;
+    std::uint64_t offset;
+    std::uint64_t size;
+    /// xxh64 of the section's contents
+    std::uint64_t checksum;
+};
+
+struct SnapshotState {
+    std::int64_t size;
+    std::int64_t gap_begin;
+    std::int64_t gap_length;
+    std::int64_t cursor_pos;
+    std::int64_t cursor_line;
+    std::int64_t cursor_col;
+    std::int64_t reserved[2];
+};
+
+static std::uint64_t header_checksum(SnapshotHeader header, std::span<const SnapshotSection> directory) {
+    header.checksum = 0;
+    Xxh64Stream stream;
+    stream.update(&header, sizeof(header));
+    stream.update(directory.data(), directory.size_bytes());
+    return stream.digest();
+}
+
+static std::uint64_t align_up(std::uint64_t offset) {
+    return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+}
+
+std::uint64_t file_stamp(const std::filesystem::path &path) {
+    std::error_code err;
+    const auto size = std::filesystem::file_size(path, err);
+    if (err) return 0;
+    const auto write_time = std::filesystem::last_write_time(path, err);
+    if (err) return 0;
+    const auto ticks = static_cast<std::uint64_t>(write_time.time_since_epoch().count());
+    const std::uint64_t stamp[2]{size, ticks};
+    return xxh64(stamp, sizeof(stamp));
+}
+
+static bool write_snapshot(const GapBuffer &buffer, const LineIndex *lines, const std::filesystem::path &path, std::uint64_t source_stamp) {
+    SnapshotState state{};
+    state.size = buffer.size();
+    state.gap_begin = buffer.state.gap.begin;
+    state.gap_length = buffer.state.gap.length;
+    state.cursor_pos = buffer.state.cursor.pos;
+    state.cursor_line = buffer.state.cursor.line;
+    state.cursor_col = buffer.state.cursor.col;
+    if (buffer.pending_edit_count() > 0) {
+        // with staged edits, the stored gap doesn't describe the text as the user sees it. Any position in it will do for the restored buffer
+        state.gap_begin = buffer.state.cursor.pos;
+    }
+
+    std::vector<SnapshotSection> directory;
+    directory.push_back({STATE_TAG, 0, 0, sizeof(state), xxh64(&state, sizeof(state))});
+    Xxh64Stream text_hash;
+    buffer.for_each_segment(0, buffer.size(), [&text_hash](std::span<const char> segment) { text_hash.update(segment); });
+    directory.push_back({TEXT_TAG, 0, 0, static_cast<std::uint64_t>(buffer.size()), text_hash.digest()});
+    if (lines != nullptr) {
+        const auto &starts = lines->starts();
+        directory.push_back({LINE_TAG, 0, 0, starts.size() * sizeof(int), xxh64(starts.data(), starts.size() * sizeof(int))});
+    }
+    auto offset = align_up(sizeof(SnapshotHeader) + directory.size() * sizeof(SnapshotSection));
+    for (auto &section : directory) {
+        section.offset = offset;
+        offset = align_up(offset + section.size);
+    }
+
+    SnapshotHeader header{SNAPSHOT_MAGIC, SNAPSHOT_VERSION, SNAPSHOT_ENDIANNESS, offset, source_stamp, static_cast<std::uint32_t>(directory.size()), 0, 0};
+    header.checksum = header_checksum(header, directory);
+
+    auto tmp_path = path;
+    tmp_path += ".tmp";
+    // a failed write leaves no half written file behind. Only a regular file is removed, whatever else is at tmp_path isn't ours
+    const auto discard_tmp = [&tmp_path] {
+        std::error_code ignored;
+        if (std::filesystem::is_regular_file(tmp_path, ignored)) std::filesystem::remove(tmp_path, ignored);
+        return false;
+    };
+    {
+        std::ofstream out{tmp_path, std::ios::binary | std::ios::trunc};
+        if (!out) return discard_tmp();
+        std::uint64_t written = 0;
+        const auto write = [&](const void *bytes, std::uint64_t length) {
+            out.write(static_cast<const char *>(bytes), static_cast<std::streamsize>(length));
+            written += length;
+        };
+        const auto pad_to = [&](std::uint64_t to) {
+            static constexpr char zeroes[SECTION_ALIGNMENT]{};
+            write(zeroes, to - written);
+        };
+        write(&header, sizeof(header));
+        write(directory.data(), directory.size() * sizeof(SnapshotSection));
+        pad_to(directory[0].offset);
+        write(&state, sizeof(state));
+        pad_to(directory[1].offset);
+        buffer.for_each_segment(0, buffer.size(), [&write](std::span<const char> segment) { write(segment.data(), segment.size()); });
+        if (lines != nullptr) {
+            pad_to(directory[2].offset);
+            write(lines->starts().data(), directory[2].size);
+        }
+        pad_to(header.file_size);
+        if (!out.flush()) {
+            out.close();
+            return discard_tmp();
+        }
+    }
+    std::error_code err;
+    std::filesystem::rename(tmp_path, path, err);
+    if (err) return discard_tmp();
+    return true;
+}
+
+bool write_snapshot(const GapBuffer &buffer, const std::filesystem::path &path, std::uint64_t source_stamp) {
+    return write_snapshot(buffer, nullptr, path, source_stamp);
+}
+
+bool write_snapshot(const Text &text, const std::filesystem::path &path, std::uint64_t source_stamp) {
+    return write_snapshot(text.buffer(), &text.lines(), path, source_stamp);
+}
+
+std::optional<SnapshotView> SnapshotView::open(const std::filesystem::path &path, std::uint64_t expected_stamp, SnapshotError *error) {
+    const auto fail = [error](SnapshotError reason) -> std::optional<SnapshotView> {
+        if (error != nullptr) *error = reason;
+        return {};
+    };
+    auto file = vmem::MappedFile::open(path);
+    if (!file) return fail(SnapshotError::Io);
+    const auto bytes = file->bytes();
+
+    SnapshotHeader header;
+    if (bytes.size() < sizeof(header)) return fail(SnapshotError::BadMagic);
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (header.magic != SNAPSHOT_MAGIC) return fail(SnapshotError::BadMagic);
+    if (header.version != SNAPSHOT_VERSION || header.endianness != SNAPSHOT_ENDIANNESS) return fail(SnapshotError::UnsupportedVersion);
+    if (header.file_size != bytes.size()) return fail(SnapshotError::Corrupt);
+    if ((bytes.size() - sizeof(header)) / sizeof(SnapshotSection) < header.section_count) return fail(SnapshotError::Corrupt);
+    std::vector<SnapshotSection> directory(header.section_count);
+    std::memcpy(directory.data(), bytes.data() + sizeof(header), directory.size() * sizeof(SnapshotSection));
+    if (header_checksum(header, directory) != header.checksum) return fail(SnapshotError::ChecksumMismatch);
+    if (header.source_stamp != expected_stamp) return fail(SnapshotError::Stale);
+
+    SnapshotView view{std::move(*file)};
+    for (const auto &section : directory) {
+        if (section.offset > bytes.size() || section.size > bytes.size() - section.offset || section.offset % SECTION_ALIGNMENT != 0) return fail(SnapshotError::Corrupt);
+        const auto contents = bytes.data() + section.offset;
+        if (xxh64(contents, section.size) != section.checksum) return fail(SnapshotError::ChecksumMismatch);
+        if (section.tag == STATE_TAG) {
+            if (section.size != sizeof(SnapshotState)) return fail(SnapshotError::Corrupt);
+            view.state = reinterpret_cast<const SnapshotState *>(contents);
+        } else if (section.tag == TEXT_TAG) {
+            view.contents = std::string_view{contents, section.size};
+        } else if (section.tag == LINE_TAG) {
+            if (section.size % sizeof(int) != 0) return fail(SnapshotError::Corrupt);
+            view.lines = std::span<const int>{reinterpret_cast<const int *>(contents), section.size / sizeof(int)};
+        }
+    }
+    if (view.state == nullptr || view.contents.data() == nullptr) return fail(SnapshotError::Corrupt);
+    const auto size = static_cast<std::int64_t>(view.contents.size());
+    if (view.state->size != size || view.state->gap_begin < 0 || view.state->gap_begin > size || view.state->gap_length < 0 ||
+        view.state->cursor_pos < 0 || view.state->cursor_pos > size || view.state->cursor_line < 0 || view.state->cursor_line > view.state->cursor_pos ||
+        view.state->cursor_col < 0 || view.state->cursor_col > view.state->cursor_pos || size > std::numeric_limits<int>::max()) {
+        return fail(SnapshotError::Corrupt);
+    }
+    if (error != nullptr) *error = SnapshotError::None;
+    return view;
+}
+
+std::string_view SnapshotView::text() const {
+    return contents;
+}
+
+Gap SnapshotView::gap() const {
+    return Gap{static_cast<int>(state->gap_begin), static_cast<int>(std::min<std::int64_t>(state->gap_length, std::numeric_limits<int>::max() - state->size))};
+}
+
+int SnapshotView::cursor_pos() const {
+    return static_cast<int>(state->cursor_pos);
+}
+
+int SnapshotView::cursor_line() const {
+    return static_cast<int>(state->cursor_line);
+}
+
+int SnapshotView::cursor_col() const {
+    return static_cast<int>(state->cursor_col);
+}
+
+std::span<const int> SnapshotView::line_starts() const {
+    return lines;
+}
+
+void restore_snapshot(const SnapshotView &snapshot, GapBuffer &buffer) {
+    const auto gap = snapshot.gap();
+    // the gap is restored to where it was, but not necessarily to its old length, which could be most of a huge, since emptied buffer
+    buffer.assign(snapshot.text(), gap.begin, std::min(gap.length, buffer.growth_policy().max_gap_size));
+    // the cursor's line & column are stored, rather than counted over the text up to it again
+    buffer.state.cursor.pos = snapshot.cursor_pos();
+    buffer.state.cursor.line = snapshot.cursor_line();
+    buffer.state.cursor.col = snapshot.cursor_col();
+}
+
+void restore_snapshot(const SnapshotView &snapshot, Text &text) {
+    const auto size_before = text.size();
+    const auto lines_before = text.line_index.line_count();
+    restore_snapshot(snapshot, text.gap_buffer);
+    if (snapshot.line_starts().empty()) {
+        text.line_index.rebuild(text.gap_buffer);
+    } else {
+        text.line_index.assign(snapshot.line_starts());
+    }
+    text.record_reload(size_before, lines_before);
+}
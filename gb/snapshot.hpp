@@ -0,0 +1,66 @@
+//
+// Created by 46769 on 2021-02-08.
+//
+
+#pragma once
+#include "gap_buffer.hpp"
+#include "memory.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+
+class Text;
+struct SnapshotState;
+
+/* Binary session snapshots of GapBuffers / Texts, so that restoring a session doesn't have to re-read & re-scan every file.
+ *
+ * Layout (native endianness, which is checked on load):
+ *  header      magic, format version, file size, source stamp, section count & a checksum over header + section directory
+ *  directory   one entry per section: tag, offset, size & checksum of the section's contents
+ *  sections    each aligned to 64 bytes, so that they can be used in place when the file is mapped into memory
+ *      STAT    buffer state: size, gap position & length, cursor position, line & column
+ *      TEXT    the text contents, without the gap
+ *      LINE    line starts (int32), optional
+ * Readers skip sections with tags they don't know, so new sections can be added without bumping the format version. */
+
+enum class SnapshotError { None, Io, BadMagic, UnsupportedVersion, Corrupt, ChecksumMismatch, Stale };
+
+/// Identifies the version of a file on disk, from its size & last write time. A snapshot taken of a file, is stale once this changes
+std::uint64_t file_stamp(const std::filesystem::path &path);
+
+/// Writes a snapshot of buffer to path. source_stamp identifies the file the buffer's contents came from (see file_stamp). The file is written
+/// to a temporary next to path, and renamed over it once complete, so a crash mid-write never leaves a half written snapshot behind
+bool write_snapshot(const GapBuffer &buffer, const std::filesystem::path &path, std::uint64_t source_stamp);
+/// Same as above, but also stores the indexes Text keeps
+bool write_snapshot(const Text &text, const std::filesystem::path &path, std::uint64_t source_stamp);
+
+/// A validated snapshot file, mapped into memory. Everything it hands out points straight into the mapping, so it can be used
+/// (to display the text, look up lines, etc) before, or instead of, restoring it into a buffer
+class SnapshotView {
+public:
+    /// Maps & validates the snapshot at path. Fails if the file is not a snapshot, any checksum doesn't match, or it was taken of a different version
+    /// of the source file than expected_stamp
+    static std::optional<SnapshotView> open(const std::filesystem::path &path, std::uint64_t expected_stamp, SnapshotError *error = nullptr);
+
+    std::string_view text() const;
+    Gap gap() const;
+    int cursor_pos() const;
+    int cursor_line() const;
+    int cursor_col() const;
+    /// Empty if the snapshot holds no line index
+    std::span<const int> line_starts() const;
+
+private:
+    explicit SnapshotView(vmem::MappedFile file) : file(std::move(file)) {}
+    vmem::MappedFile file;
+    const SnapshotState *state{nullptr};
+    std::string_view contents;
+    std::span<const int> lines;
+};
+
+/// Restores buffer to the contents, gap layout & cursor state of snapshot
+void restore_snapshot(const SnapshotView &snapshot, GapBuffer &buffer);
+/// Restores text, and the indexes it keeps, to the state in snapshot. Indexes not in the snapshot are rebuilt
+void restore_snapshot(const SnapshotView &snapshot, Text &text);
@@ -3,3 +3,189 @@
 //
 
 #include "text.hpp"
+#include <algorithm>
+
+Text::Text(int starting_capacity, int gap_size) : gap_buffer(starting_capacity, gap_size) {}
+
+void Text::insert(char ch) {
+    const auto pos = cursor();
+    const auto lines_before = line_index.line_count();
+    gap_buffer.insert(ch);
+    line_index.on_insert(pos, {&ch, 1});
+    record_change(pos, 0, 1, lines_before);
+}
+
+void Text::insert_str(std::string_view text) {
+    const auto pos = cursor();
+    const auto lines_before = line_index.line_count();
+    gap_buffer.insert_str(text);
+    line_index.on_insert(pos, text);
+    record_change(pos, 0, static_cast<int>(text.size()), lines_before);
+}
+
+void Text::erase_forward(int char_count) {
+    const auto pos = cursor();
+    const auto size_before = size();
+    const auto lines_before = line_index.line_count();
+    gap_buffer.erase_forward(char_count);
+    line_index.on_erase(pos, size_before - size());
+    record_change(pos, size_before - size(), 0, lines_before);
+}
+
+void Text::erase_backward(int char_count) {
+    const auto size_before = size();
+    const auto lines_before = line_index.line_count();
+    gap_buffer.erase_backward(char_count);
+    line_index.on_erase(cursor(), size_before - size());
+    record_change(cursor(), size_before - size(), 0, lines_before);
+}
+
+void Text::replace(int pos, int length, std::string_view text) {
+    GAP_BUFFER_ASSERT(pos >= 0 && pos <= size());
+    pos = std::clamp(pos, 0, size());
+    length = std::clamp(length, 0, size() - pos);
+    const auto lines_before = line_index.line_count();
+    gap_buffer.replace(pos, length, text);
+    line_index.on_replace(pos, length, text);
+    record_change(pos, length, static_cast<int>(text.size()), lines_before);
+}
+
+void Text::erase_range(int pos, int length) {
+    replace(pos, length, {});
+}
+
+void Text::clear() {
+    const auto size_before = size();
+    const auto lines_before = line_index.line_count();
+    gap_buffer.clear();
+    line_index.assign({});
+    record_change(0, size_before, 0, lines_before);
+}
+
+void Text::move_cursor_to(int index) {
+    gap_buffer.move_cursor_to(index);
+}
+
+void Text::move_cursor_forward(int steps) {
+    gap_buffer.move_cursor_forward(steps);
+}
+
+void Text::move_cursor_backward(int steps) {
+    gap_buffer.move_cursor_backward(steps);
+}
+
+int Text::cursor() const {
+    return gap_buffer.state.cursor.pos;
+}
+
+int Text::size() const {
+    return gap_buffer.size();
+}
+
+std::uint64_t Text::version() const {
+    return edit_version;
+}
+
+const GapBuffer &Text::buffer() const {
+    return gap_buffer;
+}
+
+const LineIndex &Text::lines() const {
+    return line_index;
+}
+
+ChangeNotifier::Subscription Text::subscribe(ChangeListener listener) {
+    return notifier.subscribe(std::move(listener));
+}
+
+void Text::unsubscribe(ChangeNotifier::Subscription subscription) {
+    notifier.unsubscribe(subscription);
+}
+
+void Text::begin_transaction() {
+    notifier.begin_transaction();
+}
+
+void Text::end_transaction() {
+    notifier.end_transaction();
+}
+
+const DirtyRanges &Text::dirty_ranges() const {
+    return dirty;
+}
+
+void Text::clear_dirty_ranges() {
+    dirty.clear();
+}
+
+MarkerSet &Text::markers() {
+    return marker_set;
+}
+
+const MarkerSet &Text::markers() const {
+    return marker_set;
+}
+
+ContentHash &Text::content_hash() {
+    hash.build(gap_buffer);
+    return hash;
+}
+
+const ContentHash &Text::content_hash() const {
+    hash.build(gap_buffer);
+    return hash;
+}
+
+int Text::display_column(int pos) const {
+    return columns.column_of(gap_buffer, line_index, pos);
+}
+
+int Text::position_at_column(int line, int column) const {
+    return columns.position_of(gap_buffer, line_index, line, column);
+}
+
+void Text::set_tab_width(int width) {
+    columns.set_tab_width(width);
+}
+
+const BracketIndex &Text::brackets() const {
+    bracket_index.build(gap_buffer);
+    return bracket_index;
+}
+
+Utf16Position Text::to_utf16(int pos) const {
+    return utf16.to_utf16(gap_buffer, line_index, pos);
+}
+
+int Text::from_utf16(Utf16Position position) const {
+    return utf16.from_utf16(gap_buffer, line_index, position);
+}
+
+void Text::to_utf16(std::span<const int> positions, std::span<Utf16Position> out) const {
+    utf16.to_utf16(gap_buffer, line_index, positions, out);
+}
+
+void Text::from_utf16(std::span<const Utf16Position> positions, std::span<int> out) const {
+    utf16.from_utf16(gap_buffer, line_index, positions, out);
+}
+
+void Text::record_change(int offset, int removed, int inserted, int line_count_before) {
+    if (removed == 0 && inserted == 0) return;
+    edit_version++;
+    const ChangeEvent event{offset, removed, inserted, line_index.line_count() - line_count_before};
+    dirty.add(event);
+    marker_set.on_change(event);
+    hash.on_change(event, gap_buffer);
+    bracket_index.on_change(event, gap_buffer);
+    columns.on_change(event, line_index);
+    utf16.on_change(event, gap_buffer);
+    if (notifier.has_subscribers()) notifier.notify(event);
+}
+
+void Text::record_reload(int size_before, int line_count_before) {
+    // rescanning all of the new text for the indexes that are built on first use would cost as much as building them, so they're dropped instead
+    hash.clear();
+    bracket_index.clear();
+    utf16.clear();
+    record_change(0, size_before, size(), line_count_before);
+}
@@ -3,13 +3,99 @@
 //
 
 #pragma once
+#include "brackets.hpp"
+#include "changes.hpp"
+#include "content_hash.hpp"
+#include "display_columns.hpp"
 #include "gap_buffer.hpp"
+#include "line_index.hpp"
+#include "markers.hpp"
+#include "utf16.hpp"
+#include <cstdint>
 
-// The actual interface to use the GapBuffer via, in CXGledit
+class SnapshotView;
+
+// The actual interface to use the GapBuffer via, in CXGledit. Edits go through Text, so that the indexes it keeps over the buffer stay up to date
 
 class Text {
 public:
-    Text();
+    explicit Text(int starting_capacity = 1024, int gap_size = 16);
+
+    /// Inserts character at cursor position
+    void insert(char ch);
+    /// Inserts a range of characters at cursor position
+    void insert_str(std::string_view text);
+    /// erases char(s) at the cursor, as if user pressed "DELETE"
+    void erase_forward(int char_count = 1);
+    /// erases char(s) before the cursor, as if user pressed "BACKSPACE"
+    void erase_backward(int char_count = 1);
+    /// Replaces text positions [pos, pos + length) with text, as one edit (see GapBuffer::replace)
+    void replace(int pos, int length, std::string_view text);
+    void erase_range(int pos, int length);
+    void clear();
+
+    void move_cursor_to(int index);
+    void move_cursor_forward(int steps);
+    void move_cursor_backward(int steps);
+
+    /// Returns the text position of the cursor
+    int cursor() const;
+    int size() const;
+    /// Counts edits. Anything computed from the text at one version (positions, diffs, edit batches) is only known to still apply at that version
+    std::uint64_t version() const;
+    const GapBuffer &buffer() const;
+    const LineIndex &lines() const;
+
+    /// Registers listener to be called with the change events of every edit. Cheap to hold; an edit with no subscribers builds no events
+    ChangeNotifier::Subscription subscribe(ChangeListener listener);
+    void unsubscribe(ChangeNotifier::Subscription subscription);
+    /// Edits made between begin_transaction() & end_transaction() are delivered to subscribers as one batch when the outermost transaction ends
+    void begin_transaction();
+    void end_transaction();
+    /// The ranges edited since the last call to clear_dirty_ranges(), coalesced
+    const DirtyRanges &dirty_ranges() const;
+    void clear_dirty_ranges();
+    /// Positions that follow the text as it's edited. Sets with other gravity can be kept up to date by feeding them from a subscription
+    MarkerSet &markers();
+    const MarkerSet &markers() const;
+    /// Digest of the text, built on the first call & kept up to date per edit from then on. Call mark_saved() on it after loading or saving, to
+    /// dirty-check against the file. A load or a snapshot restore drops it, so references to it have to be fetched again after one
+    ContentHash &content_hash();
+    const ContentHash &content_hash() const;
+    /// Returns the display column text position pos is at, with tabs expanded & wide characters counted double
+    int display_column(int pos) const;
+    /// Returns the text position of the character on line that covers display column column, or the end of the line if it's shorter than that
+    int position_at_column(int line, int column) const;
+    void set_tab_width(int width);
+    /// Bracket positions, for bracket matching & fold regions. Built on the first call & kept up to date per edit from then on, until a load or a
+    /// snapshot restore drops it, like content_hash()
+    const BracketIndex &brackets() const;
+    /// Converts text positions to language server positions (line, UTF-16 code units into the line) & back. The batched versions do the whole
+    /// batch in one walk over the text, see Utf16Index
+    Utf16Position to_utf16(int pos) const;
+    int from_utf16(Utf16Position position) const;
+    void to_utf16(std::span<const int> positions, std::span<Utf16Position> out) const;
+    void from_utf16(std::span<const Utf16Position> positions, std::span<int> out) const;
+
 private:
-    GapBuffer buffer;
-};
\ No newline at end of file
+    void record_change(int offset, int removed, int inserted, int line_count_before);
+    /// Records an edit that replaced the whole text, as a load or a restore does
+    void record_reload(int size_before, int line_count_before);
+
+
+    friend void restore_snapshot(const SnapshotView &snapshot, Text &text);
+    friend class FileLoader;
+    GapBuffer gap_buffer;
+    LineIndex line_index;
+    ChangeNotifier notifier;
+    DirtyRanges dirty;
+    MarkerSet marker_set;
+    /// Built on first use, as are bracket_index & utf16, see record_reload()
+    mutable ContentHash hash;
+    mutable BracketIndex bracket_index;
+    /// A cache, filled in by lookups
+    mutable DisplayColumns columns;
+    /// Built on the first conversion
+    mutable Utf16Index utf16;
+    std::uint64_t edit_version{0};
+};
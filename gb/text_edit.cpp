@@ -0,0 +1,34 @@
+//
+// Created by 46769 on 2021-02-10.
+//
+
+#include "text_edit.hpp"
+#include "gap_buffer.hpp"
+#include "text.hpp"
+#include <ranges>
+
+template<typename Buffer>
+static void apply_edits_back_to_front(Buffer &buffer, std::span<const TextEdit> edits) {
+    for (const auto &edit : edits | std::views::reverse) buffer.replace(edit.offset, edit.removed, edit.inserted);
+}
+
+void apply_edits(GapBuffer &buffer, std::span<const TextEdit> edits) {
+    apply_edits_back_to_front(buffer, edits);
+}
+
+void apply_edits(Text &text, std::span<const TextEdit> edits) {
+    text.begin_transaction();
+    apply_edits_back_to_front(text, edits);
+    text.end_transaction();
+}
+
+bool valid_edits(std::span<const TextEdit> edits, int size) {
+    // 64 bit sums, so that offset + removed can't overflow for garbage input
+    long long previous_end = 0;
+    for (const auto &edit : edits) {
+        const auto end = static_cast<long long>(edit.offset) + edit.removed;
+        if (edit.offset < previous_end || edit.removed < 0 || end > size) return false;
+        previous_end = end;
+    }
+    return true;
+}
@@ -0,0 +1,26 @@
+//
+// Created by 46769 on 2021-02-10.
+//
+
+#pragma once
+#include <span>
+#include <string>
+
+class GapBuffer;
+class Text;
+
+/// Replaces the text positions [offset, offset + removed) with inserted. Used for batches of edits, where every offset refers to the text
+/// as it was before any edit of the batch was applied
+struct TextEdit {
+    int offset;
+    int removed;
+    std::string inserted;
+};
+
+/// Applies a batch of non-overlapping edits, sorted by offset. They're applied back to front, so that the offsets stay valid, and so
+/// that the gap only ever travels towards the start of the buffer
+void apply_edits(GapBuffer &buffer, std::span<const TextEdit> edits);
+void apply_edits(Text &text, std::span<const TextEdit> edits);
+/// Whether edits can be applied to a text of size characters: every range lies within it, & the edits are sorted by offset without overlapping.
+/// apply_edits only asserts this, so edits from elsewhere (see EditQueue) should be checked first
+bool valid_edits(std::span<const TextEdit> edits, int size);
@@ -0,0 +1,188 @@
+//
+// Created by 46769 on 2021-02-19.
+//
+
+#include "utf16.hpp"
+#include "gap_buffer.hpp"
+#include "line_index.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <climits>
+#include <numeric>
+
+Utf16Index::Node Utf16Index::combine(const Node &left, const Node &right) {
+    return Node{left.length + right.length, left.units + right.units};
+}
+
+std::pair<Utf16Index::Block, Utf16Index::Node> Utf16Index::scan(const GapBuffer &buffer, int begin, int end) {
+    Node node{end - begin, 0};
+    buffer.for_each_segment(begin, end, [&node](std::span<const char> segment) { node.units += static_cast<int>(simd::utf16_units(segment)); });
+    return {Block{}, node};
+}
+
+void Utf16Index::rebuild(const GapBuffer &buffer) {
+    blocks.rebuild(buffer.size(), [&buffer](int begin, int end) { return scan(buffer, begin, end); });
+    built = true;
+}
+
+void Utf16Index::build(const GapBuffer &buffer) {
+    if (!built) rebuild(buffer);
+}
+
+void Utf16Index::clear() {
+    built = false;
+    blocks.clear();
+}
+
+int Utf16Index::block_count() const {
+    return blocks.size();
+}
+
+void Utf16Index::on_change(const ChangeEvent &event, const GapBuffer &buffer) {
+    if (!built) return;
+    blocks.on_change(event, buffer.size(), [&buffer](int begin, int end) { return scan(buffer, begin, end); });
+}
+
+Utf16Index::Cursor Utf16Index::block_at_position(int pos) const {
+    const auto before = blocks.descend([pos](const Node &prefix) { return pos >= prefix.length; }).second;
+    return {before.length, before.units};
+}
+
+Utf16Index::Cursor Utf16Index::block_at_units(int units) const {
+    const auto before = blocks.descend([units](const Node &prefix) { return units >= prefix.units; }).second;
+    return {before.length, before.units};
+}
+
+Utf16Index::Cursor Utf16Index::scan_to(const GapBuffer &buffer, Cursor from, int pos) {
+    buffer.for_each_segment(from.pos, pos, [&from](std::span<const char> segment) { from.units += static_cast<int>(simd::utf16_units(segment)); });
+    from.pos = pos;
+    return from;
+}
+
+Utf16Index::Cursor Utf16Index::scan_to_units(const GapBuffer &buffer, Cursor from, int units, int limit) {
+    buffer.for_each_segment(from.pos, limit, [&](std::span<const char> segment) {
+        const auto p = segment.data();
+        const auto length = segment.size();
+        std::size_t i = 0;
+        // 8 bytes at a time, as long as every character starting in them ends at or before units
+        for (; i + 8 <= length; i += 8) {
+            const auto word_units = simd::utf16_units(simd::load64(p + i));
+            if (from.units + word_units > units) break;
+            from.units += word_units;
+        }
+        for (; i < length; i++) {
+            const auto ch = static_cast<unsigned char>(p[i]);
+            if ((ch & 0xc0) == 0x80) continue;
+            const auto width = ch >= 0xf0 ? 2 : 1;
+            if (from.units + width > units) {
+                from.pos += static_cast<int>(i);
+                return false;
+            }
+            from.units += width;
+        }
+        from.pos += static_cast<int>(length);
+        return true;
+    });
+    return from;
+}
+
+Utf16Index::Cursor Utf16Index::cursor_at(const GapBuffer &buffer, int pos) const {
+    return scan_to(buffer, block_at_position(pos), pos);
+}
+
+void Utf16Index::Walk::count_from_text_start(const Utf16Index &index, const GapBuffer &buffer) {
+    if (absolute) return;
+    const auto start = index.cursor_at(buffer, line_start).units;
+    at.units += start - line_units;
+    line_units = start;
+    absolute = true;
+}
+
+int Utf16Index::line_end(const GapBuffer &buffer, const LineIndex &lines, int line) {
+    if (line + 1 >= lines.line_count()) return buffer.size();
+    auto end = lines.line_start(line + 1) - 1;
+    if (end > lines.line_start(line) && buffer.get_at(end - 1) == '\r') end--;
+    return end;
+}
+
+Utf16Position Utf16Index::to_utf16(const GapBuffer &buffer, const LineIndex &lines, int pos) {
+    Utf16Position result{};
+    to_utf16(buffer, lines, std::span{&pos, 1}, std::span{&result, 1});
+    return result;
+}
+
+int Utf16Index::from_utf16(const GapBuffer &buffer, const LineIndex &lines, Utf16Position position) {
+    auto result = 0;
+    from_utf16(buffer, lines, std::span{&position, 1}, std::span{&result, 1});
+    return result;
+}
+
+void Utf16Index::to_utf16(const GapBuffer &buffer, const LineIndex &lines, std::span<const int> positions, std::span<Utf16Position> out) {
+    build(buffer);
+    const auto sorted = std::is_sorted(positions.begin(), positions.end());
+    std::vector<int> order;
+    if (!sorted) {
+        order.resize(positions.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&positions](int a, int b) { return positions[a] < positions[b]; });
+    }
+    // one walk over the text, that never goes back: each position is counted from the one before it, or from its line start if it's on a later line
+    Walk walk;
+    auto line = -1, next_line_start = 0;
+    for (std::size_t k = 0; k < positions.size(); k++) {
+        const auto i = sorted ? static_cast<int>(k) : order[k];
+        const auto pos = std::clamp(positions[i], 0, buffer.size());
+        if (line < 0 || pos >= next_line_start) {
+            line = lines.line_of(pos);
+            walk = Walk{lines.line_start(line)};
+            next_line_start = line + 1 < lines.line_count() ? lines.line_start(line + 1) : INT_MAX;
+        }
+        if (pos - walk.at.pos > 2 * BlockSize) {
+            // far along a long line: skip ahead to the block pos is in, the counts of which are from the start of the text
+            walk.count_from_text_start(*this, buffer);
+            if (const auto block = block_at_position(pos); block.pos > walk.at.pos) walk.at = block;
+        }
+        walk.at = scan_to(buffer, walk.at, pos);
+        out[i] = Utf16Position{line, walk.at.units - walk.line_units};
+    }
+}
+
+void Utf16Index::from_utf16(const GapBuffer &buffer, const LineIndex &lines, std::span<const Utf16Position> positions, std::span<int> out) {
+    build(buffer);
+    const auto sorted = std::is_sorted(positions.begin(), positions.end());
+    std::vector<int> order;
+    if (!sorted) {
+        order.resize(positions.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&positions](int a, int b) { return positions[a] < positions[b]; });
+    }
+    Walk walk;
+    auto line = -1, end = 0;
+    for (std::size_t k = 0; k < positions.size(); k++) {
+        const auto i = sorted ? static_cast<int>(k) : order[k];
+        const auto position = positions[i];
+        if (position.line < 0 || position.line >= lines.line_count()) {
+            out[i] = position.line < 0 ? 0 : buffer.size();
+            continue;
+        }
+        if (position.line != line) {
+            line = position.line;
+            walk = Walk{lines.line_start(line)};
+            end = line_end(buffer, lines, line);
+        }
+        // no byte counts for more than 2 code units (the lead byte of a surrogate pair, or a stray one), so this many is past the end of the line
+        const auto character = std::clamp(position.character, 0, 2 * (end - walk.line_start));
+        if (walk.line_units + character - walk.at.units > 2 * BlockSize) {
+            walk.count_from_text_start(*this, buffer);
+            const auto block = block_at_units(walk.line_units + character);
+            if (block.pos >= end) {
+                walk.at = cursor_at(buffer, end);
+                out[i] = end;
+                continue;
+            }
+            if (block.pos > walk.at.pos) walk.at = block;
+        }
+        walk.at = scan_to_units(buffer, walk.at, walk.line_units + character, end);
+        out[i] = walk.at.pos;
+    }
+}
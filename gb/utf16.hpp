@@ -0,0 +1,95 @@
+//
+// Created by 46769 on 2021-02-19.
+//
+
+#pragma once
+#include "block_tree.hpp"
+#include "changes.hpp"
+#include <span>
+#include <utility>
+#include <vector>
+
+class GapBuffer;
+class LineIndex;
+
+/// A position as the Language Server Protocol counts them by default: a 0-based line, and the UTF-16 code units from the start of that line
+struct Utf16Position {
+    int line;
+    int character;
+    friend bool operator==(const Utf16Position &, const Utf16Position &) = default;
+    friend auto operator<=>(const Utf16Position &, const Utf16Position &) = default;
+};
+
+/// Converts text positions (byte offsets into the UTF-8 text) to Utf16Positions & back, without walking the text from the start of the line.
+/// Like BracketIndex, the text is split into blocks of around BlockSize characters, here summarized by their length in UTF-16 code units, and
+/// combined in a BlockTree; a conversion is a descent of the tree, plus a scan of part of one block. Code units are counted per byte (see
+/// simd::utf16_units), so a block boundary may fall inside a character, and a malformed sequence counts one unit per byte that isn't a
+/// continuation byte. Batched conversions are sorted & done in one walk, which scans from one position to the next when they're close, and
+/// only goes through the tree for the gaps between them that are larger than a block.
+/// The index is built on the first conversion, & from then on an edit only rescans the blocks it touched
+class Utf16Index {
+public:
+    static constexpr int BlockSize = 1024;
+
+    Utf16Index() = default;
+    /// Rebuilds all blocks from the buffer
+    void rebuild(const GapBuffer &buffer);
+    /// Rescans the blocks touched by an edit, if the index has been built. buffer must already contain the edit
+    void on_change(const ChangeEvent &event, const GapBuffer &buffer);
+    /// Drops the index, until the next conversion builds it again
+    void clear();
+
+    /// Returns the line & UTF-16 column of text position pos
+    Utf16Position to_utf16(const GapBuffer &buffer, const LineIndex &lines, int pos);
+    /// Returns the text position of position. A character past the end of the line maps to the end of the line (before its line break), and one in
+    /// the middle of a surrogate pair to the start of the pair. Lines before the first map to 0, and lines past the last to the end of the text
+    int from_utf16(const GapBuffer &buffer, const LineIndex &lines, Utf16Position position);
+    /// Converts positions to out, which must be as large. Cheapest when positions are sorted, but any order is fine
+    void to_utf16(const GapBuffer &buffer, const LineIndex &lines, std::span<const int> positions, std::span<Utf16Position> out);
+    void from_utf16(const GapBuffer &buffer, const LineIndex &lines, std::span<const Utf16Position> positions, std::span<int> out);
+    int block_count() const;
+
+private:
+    struct Node {
+        int length{0};
+        int units{0};
+    };
+    /// Blocks are summarized by their Node alone
+    struct Block {};
+    /// A text position & the code units before it
+    struct Cursor {
+        int pos;
+        int units;
+    };
+
+    static Node combine(const Node &left, const Node &right);
+    /// Counts the code units of text positions [begin, end)
+    static std::pair<Block, Node> scan(const GapBuffer &buffer, int begin, int end);
+    void build(const GapBuffer &buffer);
+
+    /// Returns the start of the block containing pos, or of the one where the code units reach units
+    Cursor block_at_position(int pos) const;
+    Cursor block_at_units(int units) const;
+    /// Counts the code units from from to text position pos, which may not be before it
+    static Cursor scan_to(const GapBuffer &buffer, Cursor from, int pos);
+    /// Moves from to the start of the character that covers code unit units, stopping at limit
+    static Cursor scan_to_units(const GapBuffer &buffer, Cursor from, int units, int limit);
+    /// Returns pos, with the code units before it counted from the start of the text
+    Cursor cursor_at(const GapBuffer &buffer, int pos) const;
+
+    /// The state of a batched conversion, on one line. Code units are counted from the line start, until the walk has to skip ahead through the
+    /// tree, whose counts are from the start of the text
+    struct Walk {
+        int line_start{0};
+        int line_units{0};
+        Cursor at{line_start, 0};
+        bool absolute{false};
+        void count_from_text_start(const Utf16Index &index, const GapBuffer &buffer);
+    };
+
+    /// Returns the end of line, excluding its line break ("\n" or "\r\n")
+    static int line_end(const GapBuffer &buffer, const LineIndex &lines, int line);
+
+    bool built{false};
+    BlockTree<Block, Node, &Utf16Index::combine, BlockSize> blocks;
+};
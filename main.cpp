@@ -2,11 +2,20 @@
 #define FMT_ENFORCE_COMPILE_STRING
 #include <array>
 #include <filesystem>
+#include <fstream>
 #include <fmt/core.h>
 #include <fmt/format.h>
+#include <gb/diff.hpp>
+#include <gb/edit_queue.hpp>
 #include <gb/gap_buffer.hpp>
+#include <gb/line_ops.hpp>
+#include <gb/loader.hpp>
+#include <gb/segmented.hpp>
+#include <gb/snapshot.hpp>
+#include <gb/text.hpp>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <unittest/unit_test.hpp>
 #include <vector>
 
@@ -436,6 +445,859 @@ void clear_test() {
     UnitTestPush(FORMAT("Size expected: {}, got: {}", 0, gb.size()), 0 == gb.size());
 }
 
+void iterators_test() {
+    BeginUnitTest();
+    constexpr auto content = "hello world says c++"sv;
+    auto gbs = setup_gapbuffers();
+    for (auto &gb : gbs) {
+        gb.insert_str(content);
+        for (auto cursor = 0; cursor <= gb.size(); cursor += 3) {
+            // move the gap around, so that the segments are split at different places
+            gb.move_cursor_to(cursor);
+            gb.insert('#');
+            gb.erase_backward(1);
+
+            std::string copied;
+            segmented::copy(gb.begin(), gb.end(), std::back_inserter(copied));
+            UnitTestPush(FORMAT("segmented::copy mismatch: {} != {}", content, copied), copied == content);
+            std::string iterated{gb.begin(), gb.end()};
+            UnitTestPush(FORMAT("iterator range mismatch: {} != {}", content, iterated), iterated == content);
+            UnitTestPush(FORMAT("std::ranges::equal failed for cursor at {}", cursor), std::ranges::equal(gb, content));
+            UnitTestPush(FORMAT("segmented::equal failed for cursor at {}", cursor), segmented::equal(gb.begin(), gb.end(), content.begin()));
+
+            auto w = segmented::find(gb.begin(), gb.end(), 'w');
+            UnitTestPush(FORMAT("segmented::find expected 6, got {}", w - gb.begin()), w - gb.begin() == 6);
+            auto none = segmented::find(gb.cbegin(), gb.cend(), 'X');
+            UnitTestPush("segmented::find expected end()", none == gb.cend());
+            auto ls = segmented::count(gb.begin() + 1, gb.end() - 1, 'l');
+            UnitTestPush(FORMAT("segmented::count expected 3, got {}", ls), ls == 3);
+            UnitTestPush("reverse iteration mismatch", std::equal(std::make_reverse_iterator(gb.end()), std::make_reverse_iterator(gb.begin()), content.rbegin()));
+        }
+        GapBuffer other{8, 2};
+        other.insert_str(content);
+        other.move_cursor_to(9);
+        other.insert('#');
+        other.erase_backward(1);
+        UnitTestPush("segmented::equal between two buffers failed", segmented::equal(gb.cbegin(), gb.cend(), other.begin(), other.end()));
+
+        segmented::transform(gb.begin(), gb.end(), gb.begin(), [](char c) { return static_cast<char>(std::toupper(c)); });
+        UnitTestPush(FORMAT("segmented::transform in place failed: {}", gb.clone_range(0, gb.size())), gb.clone_range(0, gb.size()) == "HELLO WORLD SAYS C++");
+        std::ranges::sort(gb);
+        UnitTestPush("std::ranges::sort failed", std::ranges::is_sorted(gb));
+    }
+}
+
+void edit_coalescing_test() {
+    BeginUnitTest();
+    constexpr auto content = "int main() {\n    return 0;\n}\n"sv;
+    auto gbs = setup_gapbuffers();
+    for (auto &gb : gbs) {
+        gb.insert_str(content);
+        gb.set_edit_coalescing(EditCoalescing{.enabled = true, .max_pending_edits = 4, .max_pending_bytes = 16});
+        std::string expected{content};
+
+        // ping-pong between two sites, as a completion UI inserting while the user is typing would
+        auto site_a = 10, site_b = 24;
+        for (auto i = 0; i < 6; i++) {
+            gb.move_cursor_to(site_a);
+            gb.insert('a');
+            expected.insert(site_a, 1, 'a');
+            site_a++;
+            site_b++;
+            gb.move_cursor_to(site_b);
+            gb.insert_str("bb");
+            expected.insert(site_b, "bb");
+            site_b += 2;
+            if (i % 2 == 1) {
+                gb.erase_backward(1);
+                expected.erase(site_b - 1, 1);
+                site_b--;
+            }
+            UnitTestPush(FORMAT("Size expected: {}, got: {}", expected.size(), gb.size()), gb.size() == expected.size());
+            UnitTestPush(FORMAT("clone_range mismatch: {} != {}", expected, gb.clone_range(0, gb.size())), gb.clone_range(0, gb.size()) == expected);
+            auto get_at_matches = true;
+            for (auto p = 0; p < gb.size(); p++) get_at_matches = get_at_matches && gb.get_at(p) == expected[p];
+            UnitTestPush("get_at does not see staged edits", get_at_matches);
+            UnitTestPush("segmented::equal does not see staged edits", segmented::equal(gb.cbegin(), gb.cend(), expected.begin()));
+            auto found = gb.find_from("return");
+            UnitTestPush(FORMAT("find_from expected {}, got {}", expected.find("return"), found.value_or(-1)), found && *found == static_cast<int>(expected.find("return")));
+        }
+        // erasing stored text just before & after a staged insert, merges the erase into the staged edit
+        gb.move_cursor_to(site_a + 1);
+        gb.erase_backward(2);
+        expected.erase(site_a - 1, 2);
+        gb.move_cursor_to(3);
+        gb.erase_forward();
+        expected.erase(3, 1);
+        UnitTestPush(FORMAT("clone_range mismatch: {} != {}", expected, gb.clone_range(0, gb.size())), gb.clone_range(0, gb.size()) == expected);
+
+        gb.flush_pending_edits();
+        UnitTestPush(FORMAT("Expected no pending edits after flush, got {}", gb.pending_edit_count()), gb.pending_edit_count() == 0);
+        UnitTestPush(FORMAT("Contents do not match after flush: {} != {}", expected, gb.clone_range(0, gb.size())), gb.debug_assert(expected, [](auto, auto a, auto b) { return a == b; }));
+    }
+}
+
+void growth_policy_test() {
+    BeginUnitTest();
+    GapBuffer gb{16, 4};
+    gb.set_growth_policy(GrowthPolicy{.growth_factor = 2.0, .max_gap_size = 256, .shrink_threshold = 0.25, .shrink_target = 0.5, .min_capacity = 64, .release_threshold = 4096});
+    std::string expected;
+    for (auto i = 0; i < 1000; i++) {
+        gb.insert(static_cast<char>('a' + i % 26));
+        expected.push_back(static_cast<char>('a' + i % 26));
+    }
+    UnitTestPush(FORMAT("Free space {} exceeds max gap size", gb.capacity() - gb.size()), gb.capacity() - gb.size() <= 256);
+
+    gb.move_cursor_to(900);
+    gb.erase_backward(850);
+    expected.erase(50, 850);
+    UnitTestPush(FORMAT("Expected buffer to shrink, capacity: {} size: {}", gb.capacity(), gb.size()), gb.capacity() < 4 * gb.size());
+    UnitTestPush(FORMAT("Contents do not match after shrink: {}", gb.clone_range(0, gb.size())), gb.clone_range(0, gb.size()) == expected);
+
+    // inserting & erasing around the size the buffer shrunk to, should not make it grow or shrink again
+    const auto cap = gb.capacity();
+    for (auto i = 0; i < 20; i++) {
+        gb.insert_str("0123456789");
+        gb.erase_backward(10);
+        UnitTestPush(FORMAT("Capacity oscillated: {} != {}", cap, gb.capacity()), cap == gb.capacity());
+    }
+
+    gb.shrink_to_fit();
+    UnitTestPush(FORMAT("shrink_to_fit, expected capacity {} got {}", gb.size() + gb.gap_size_setting(), gb.capacity()), gb.capacity() == gb.size() + gb.gap_size_setting());
+    UnitTestPush(FORMAT("Contents do not match after shrink_to_fit: {}", gb.clone_range(0, gb.size())), gb.clone_range(0, gb.size()) == expected);
+
+    for (auto i = 0; i < 100; i++) gb.insert_str(movement_header());
+    gb.clear();
+    UnitTestPush(FORMAT("clear() expected capacity to drop to min_capacity, got {}", gb.capacity()), gb.capacity() == 64);
+    gb.insert_str("hello world");
+    UnitTestPush(FORMAT("Contents do not match after clear: {}", gb.clone_range(0, gb.size())), gb.clone_range(0, gb.size()) == "hello world");
+
+    // with the shrink threshold out of reach, a heap buffer's large gap is reallocated away rather than having its pages released
+    GapBuffer heap{64, 16};
+    heap.set_growth_policy(GrowthPolicy{.max_gap_size = 64 * 1024, .shrink_threshold = 0.01, .min_capacity = 64, .release_threshold = 4096});
+    heap.insert_str(std::string(20000, 'x'));
+    heap.erase_backward(15000);
+    UnitTestPush("Large buffer should still live on the heap", !heap.is_mapped());
+    UnitTestPush(FORMAT("Expected the heap buffer's free space to be reallocated away, capacity: {} size: {}", heap.capacity(), heap.size()), heap.capacity() - heap.size() < std::max(4096, heap.size()));
+}
+
+void mapped_storage_test() {
+    BeginUnitTest();
+    GapBuffer gb{64, 16};
+    gb.set_growth_policy(GrowthPolicy{.max_gap_size = 64 * 1024, .min_capacity = 64, .mmap_threshold = 64 * 1024});
+    UnitTestPush("Small buffer should live on the heap", !gb.is_mapped());
+    std::string expected;
+    const auto header = movement_header();
+    for (auto i = 0; i < 200; i++) {
+        // insert in the middle, so that there's text on both sides of the gap when the buffer grows
+        const auto pos = static_cast<int>(expected.size() / 2);
+        gb.move_cursor_to(pos);
+        gb.insert_str(header);
+        expected.insert(pos, header);
+    }
+    UnitTestPush(FORMAT("Buffer of capacity {} should be mapped", gb.capacity()), gb.is_mapped());
+    UnitTestPush("Contents do not match after growing a mapped buffer", gb.clone_range(0, gb.size()) == expected);
+
+    // shrink, but stay above the mapping threshold, i.e. mremap down
+    gb.move_cursor_to(gb.size() - 10);
+    gb.erase_backward(gb.size() - 100 * 1024);
+    expected.erase(100 * 1024 - 10, expected.size() - 100 * 1024);
+    UnitTestPush("Contents do not match after shrinking a mapped buffer", gb.clone_range(0, gb.size()) == expected);
+
+    // shrink below the threshold, back to the heap
+    gb.move_cursor_to(gb.size() / 2);
+    gb.erase_backward(gb.size() / 2 - 100);
+    expected.erase(100, expected.size() / 2 - 100);
+    gb.shrink_to_fit();
+    UnitTestPush(FORMAT("Buffer of capacity {} should be on the heap", gb.capacity()), !gb.is_mapped());
+    UnitTestPush("Contents do not match after moving back to the heap", gb.clone_range(0, gb.size()) == expected);
+}
+
+void snapshot_test() {
+    BeginUnitTest();
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto source = dir / "gb_snapshot_source.txt";
+    const auto snapshot_path = dir / "gb_snapshot_test.gbsnap";
+    {
+        std::ofstream out{source, std::ios::binary};
+        out << movement_header();
+    }
+    const auto stamp = file_stamp(source);
+
+    Text text{16, 4};
+    text.insert_str(movement_header());
+    text.move_cursor_to(40);
+    text.insert_str("\n// inserted line\n");
+    text.move_cursor_to(10);
+    text.erase_backward(3);
+    LineIndex rebuilt;
+    rebuilt.rebuild(text.buffer());
+    UnitTestPush("Incrementally maintained line index does not match a rebuilt one", rebuilt.starts() == text.lines().starts());
+    UnitTestPush("Failed to write snapshot", write_snapshot(text, snapshot_path, stamp));
+
+    SnapshotError error;
+    auto view = SnapshotView::open(snapshot_path, stamp, &error);
+    UnitTestPush(FORMAT("Failed to open snapshot, error: {}", static_cast<int>(error)), view.has_value());
+    if (view) {
+        const auto contents = text.buffer().clone_range(0, text.size());
+        UnitTestPush("Snapshot text, used in place, does not match", view->text() == contents);
+        UnitTestPush("Snapshot line starts, used in place, do not match", std::ranges::equal(view->line_starts(), text.lines().starts()));
+
+        // restoring over a text whose lazily built indexes are in use drops them, & they're built again over the restored text
+        Text restored{16, 4};
+        restored.insert_str("(stale");
+        restored.content_hash();
+        restored.brackets();
+        restore_snapshot(*view, restored);
+        UnitTestPush(FORMAT("Restored contents do not match: {}", restored.buffer().clone_range(0, restored.size())), restored.buffer().clone_range(0, restored.size()) == contents);
+        UnitTestPush(FORMAT("Restored cursor expected {}, got {}", text.cursor(), restored.cursor()), restored.cursor() == text.cursor());
+        UnitTestPush("Restored cursor line & column do not match", restored.buffer().line() == text.buffer().line() && restored.buffer().col_pos() == text.buffer().col_pos());
+        UnitTestPush(FORMAT("Restored gap position expected {}, got {}", text.buffer().state.gap.begin, restored.buffer().state.gap.begin), restored.buffer().state.gap.begin == text.buffer().state.gap.begin);
+        UnitTestPush("Restored line index does not match", restored.lines().starts() == text.lines().starts());
+        UnitTestPush("Restored content hash does not match", restored.content_hash().digest() == content_digest(contents));
+        UnitTestPush("Restored bracket index does not match", restored.brackets().bracket_count() == text.brackets().bracket_count());
+    }
+    view.reset();
+
+    auto stale = SnapshotView::open(snapshot_path, stamp + 1, &error);
+    UnitTestPush("Snapshot with another source stamp, should be rejected as stale", !stale && error == SnapshotError::Stale);
+
+    {
+        // overwrite a byte of the text section, which starts after the header, section directory & state section
+        std::fstream corrupt{snapshot_path, std::ios::binary | std::ios::in | std::ios::out};
+        corrupt.seekp(300);
+        corrupt.put('#');
+    }
+    auto corrupted = SnapshotView::open(snapshot_path, stamp, &error);
+    UnitTestPush(FORMAT("Corrupt snapshot should be rejected, error: {}", static_cast<int>(error)), !corrupted && error == SnapshotError::ChecksumMismatch);
+    std::filesystem::remove(snapshot_path);
+
+    // a directory in the way fails the rename into place, which must not leave the temporary file behind
+    const auto blocked_path = dir / "gb_snapshot_test_blocked";
+    std::filesystem::create_directories(blocked_path / "occupied");
+    auto blocked_tmp = blocked_path;
+    blocked_tmp += ".tmp";
+    UnitTestPush("Writing a snapshot over a directory should fail", !write_snapshot(text, blocked_path, stamp));
+    UnitTestPush("Failed snapshot write left its temporary file behind", !std::filesystem::exists(blocked_tmp));
+    std::filesystem::remove_all(blocked_path);
+    std::filesystem::remove(source);
+}
+
+void diff_test() {
+    BeginUnitTest();
+    const std::string before = "first line\nsecond line\nthird line\nfourth line\nfifth line\n";
+    const std::string after = "first line\nsecond line, changed\nthird line\nfifth line\nsixth line\n";
+
+    GapBuffer old_buffer{8, 4};
+    old_buffer.insert_str(before);
+    old_buffer.move_cursor_to(20);// put the gap in the middle of the changed text, so the diff has to compare across segments
+    const auto diff = diff_lines(old_buffer, std::string_view{after});
+    UnitTestPush(FORMAT("Expected 3 hunks, got {}", diff.hunks.size()), diff.hunks.size() == 3);
+    if (diff.hunks.size() == 3) {
+        const auto &changed = diff.hunks[0];
+        const auto &removed = diff.hunks[1];
+        const auto &added = diff.hunks[2];
+        UnitTestPush("Changed line should be reported as replacing line 1", changed.old_line == 1 && changed.old_count == 1 && changed.new_line == 1 && changed.new_count == 1);
+        UnitTestPush("Removed line should be reported as line 3, with nothing added", removed.old_line == 3 && removed.old_count == 1 && removed.new_count == 0);
+        UnitTestPush("Added line should be reported as line 4 of the new text, with nothing removed", added.old_count == 0 && added.new_line == 4 && added.new_count == 1);
+    }
+    apply_edits(old_buffer, diff.edits);
+    UnitTestPush(FORMAT("Applying the diff to the old buffer should produce the new text, got: {}", old_buffer.clone_range(0, old_buffer.size())), old_buffer.clone_range(0, old_buffer.size()) == after);
+
+    Text old_text{8, 4}, new_text{8, 4};
+    old_text.insert_str(movement_header());
+    new_text.insert_str(movement_header());
+    new_text.move_cursor_to(100);
+    new_text.insert_str("x\ny\n");
+    new_text.move_cursor_to(10);
+    new_text.erase_backward(5);
+    const auto text_diff = diff_lines(old_text, new_text);
+    apply_edits(old_text, text_diff.edits);
+    UnitTestPush("Applying the diff of two Texts should make them equal", old_text.buffer().clone_range(0, old_text.size()) == new_text.buffer().clone_range(0, new_text.size()));
+    UnitTestPush("Line index should be kept up to date when applying a diff", old_text.lines().starts() == new_text.lines().starts());
+    UnitTestPush("Diff of equal texts should be empty", diff_lines(old_text, new_text).hunks.empty());
+    UnitTestPush("Diff without a trailing line break", diff_lines(std::string_view{"a\nb"}, std::string_view{"a\nc"}).hunks.size() == 1);
+
+    const auto limited = diff_lines(std::string_view{"a\nb\nc\nd\n"}, std::string_view{"1\nb\n2\nd\n"}, 1);
+    UnitTestPush("Diff beyond max edit distance should be reported as one hunk", limited.hunks.size() == 1 && limited.hunks[0].old_line == 0 && limited.hunks[0].old_count == 3);
+}
+
+void change_events_test() {
+    BeginUnitTest();
+    Text text{16, 4};
+    text.insert_str("line one\nline two\nline three\n");
+    text.clear_dirty_ranges();
+
+    std::vector<std::vector<ChangeEvent>> deliveries;
+    const auto subscription = text.subscribe([&deliveries](std::span<const ChangeEvent> events) { deliveries.emplace_back(events.begin(), events.end()); });
+    text.move_cursor_to(9);
+    text.insert_str("new line\n");
+    UnitTestPush(FORMAT("Expected 1 delivery, got {}", deliveries.size()), deliveries.size() == 1 && deliveries[0].size() == 1);
+    if (deliveries.size() == 1) {
+        const auto event = deliveries[0][0];
+        UnitTestPush(FORMAT("Unexpected insert event {{{}, {}, {}, {}}}", event.offset, event.removed, event.inserted, event.line_delta), event.offset == 9 && event.removed == 0 && event.inserted == 9 && event.line_delta == 1);
+    }
+
+    // typing & backspacing inside a transaction is merged into one event per run
+    deliveries.clear();
+    text.begin_transaction();
+    text.move_cursor_to(0);
+    for (auto ch : "abc"sv) text.insert(ch);
+    text.move_cursor_to(20);
+    text.erase_backward(1);
+    text.erase_backward(1);
+    UnitTestPush("Events should not be delivered before the transaction ends", deliveries.empty());
+    text.end_transaction();
+    UnitTestPush(FORMAT("Expected 1 delivery of 2 events, got {}", deliveries.size()), deliveries.size() == 1 && deliveries[0].size() == 2);
+    if (deliveries.size() == 1 && deliveries[0].size() == 2) {
+        const auto typed = deliveries[0][0];
+        const auto erased = deliveries[0][1];
+        UnitTestPush("Typed characters should be merged into one insert", typed.offset == 0 && typed.inserted == 3 && typed.removed == 0);
+        UnitTestPush("Backspaces should be merged into one erase", erased.offset == 18 && erased.removed == 2 && erased.inserted == 0);
+    }
+
+    // the dirty ranges are in current text positions: [0, 3) typed, [12, 21) the inserted line pushed forward by 3, less the 2 characters erased from it
+    const auto ranges = text.dirty_ranges().ranges();
+    UnitTestPush(FORMAT("Expected 2 dirty ranges, got {}", ranges.size()), ranges.size() == 2);
+    if (ranges.size() == 2) {
+        UnitTestPush(FORMAT("First dirty range expected [0, 3), got [{}, {})", ranges[0].begin, ranges[0].end), ranges[0].begin == 0 && ranges[0].end == 3);
+        UnitTestPush(FORMAT("Second dirty range expected [12, 19), got [{}, {})", ranges[1].begin, ranges[1].end), ranges[1].begin == 12 && ranges[1].end == 19);
+    }
+
+    text.unsubscribe(subscription);
+    deliveries.clear();
+    text.insert('x');
+    UnitTestPush("Unsubscribed listener should not be called", deliveries.empty());
+
+    // a one-shot listener, that unsubscribes itself & subscribes another one, from inside the delivery
+    auto one_shot_calls = 0, later_calls = 0;
+    ChangeNotifier::Subscription one_shot{}, later{};
+    one_shot = text.subscribe([&](std::span<const ChangeEvent>) {
+        one_shot_calls++;
+        text.unsubscribe(one_shot);
+        later = text.subscribe([&later_calls](std::span<const ChangeEvent>) { later_calls++; });
+    });
+    text.insert('y');
+    text.insert('z');
+    UnitTestPush(FORMAT("Self-unsubscribing listener called {} times, the one it subscribed {} times", one_shot_calls, later_calls), one_shot_calls == 1 && later_calls == 1);
+    text.unsubscribe(later);
+
+    // a listener unsubscribed by an earlier one in the same delivery isn't called anymore
+    auto second_calls = 0;
+    ChangeNotifier::Subscription second{};
+    const auto first = text.subscribe([&](std::span<const ChangeEvent>) { text.unsubscribe(second); });
+    second = text.subscribe([&second_calls](std::span<const ChangeEvent>) { second_calls++; });
+    text.insert('w');
+    text.unsubscribe(first);
+    UnitTestPush(FORMAT("Listener unsubscribed by an earlier one called {} times", second_calls), second_calls == 0);
+
+    DirtyRanges coalesced;
+    coalesced.add({10, 0, 5, 0});
+    coalesced.add({30, 0, 5, 0});
+    coalesced.add({12, 20, 0, 0});// erases from inside the first range to past the second one
+    UnitTestPush("Overlapping edits should coalesce into one range", coalesced.ranges().size() == 1 && coalesced.ranges()[0].begin == 10 && coalesced.ranges()[0].end == 15);
+}
+
+void markers_test() {
+    BeginUnitTest();
+    Text text{16, 4};
+    text.insert_str("0123456789abcdefghij");
+    auto &markers = text.markers();
+    std::vector<MarkerSet::Marker> handles;
+    for (auto pos = 0; pos <= 20; pos += 5) handles.push_back(markers.add(pos));// 0, 5, 10, 15, 20
+
+    text.move_cursor_to(5);
+    text.insert_str("xyz");
+    UnitTestPush(FORMAT("Marker at the insertion point should stay put, got {}", markers.position(handles[1])), markers.position(handles[1]) == 5);
+    UnitTestPush(FORMAT("Marker after the insertion point should move, got {}", markers.position(handles[2])), markers.position(handles[2]) == 13);
+
+    text.move_cursor_to(17);
+    text.erase_backward(6);// erases [11, 17), which holds the marker at 13
+    UnitTestPush(FORMAT("Marker inside erased text should collapse onto the erase point, got {}", markers.position(handles[2])), markers.position(handles[2]) == 11);
+    UnitTestPush(FORMAT("Marker after erased text should move back, got {}", markers.position(handles[3])), markers.position(handles[3]) == 12);
+    UnitTestPush(FORMAT("Marker at the end should follow the end, got {}", markers.position(handles[4])), markers.position(handles[4]) == text.size());
+
+    markers.remove(handles[0]);
+    const auto visible = markers.in_range(5, 13);
+    UnitTestPush(FORMAT("Expected 3 markers in [5, 13), got {}", visible.size()), visible.size() == 3);
+    if (visible.size() == 3) UnitTestPush("Markers in range should be ordered by position", visible[0].marker == handles[1] && visible[1].marker == handles[2] && visible[2].marker == handles[3]);
+
+    // enough markers that most of them are merged into the delta tree, compared against shifting each one by hand
+    MarkerSet many{MarkerGravity::Right};
+    std::vector<int> expected;
+    for (auto i = 0; i < 2000; i++) {
+        many.add(i * 3);
+        expected.push_back(i * 3);
+    }
+    for (auto edit = 0; edit < 50; edit++) {
+        const ChangeEvent event{edit * 97, edit % 7, edit % 5, 0};
+        many.on_change(event);
+        for (auto &pos : expected) {
+            if (pos >= event.offset + event.removed) pos -= event.removed;
+            else if (pos > event.offset) pos = event.offset;
+            if (pos >= event.offset) pos += event.inserted;
+        }
+    }
+    auto all_match = true;
+    for (auto i = 0; i < 2000; i++) all_match = all_match && many.position(i) == expected[i];
+    UnitTestPush("Marker positions after a series of edits don't match the expected ones", all_match);
+}
+
+void file_loader_test() {
+    BeginUnitTest();
+    const auto path = std::filesystem::temp_directory_path() / "gb_loader_test.txt";
+    std::string contents;
+    for (auto i = 0; i < 2000; i++) contents += FORMAT("line {} \xc3\xa5\xe2\x82\xac\xf0\x9f\x98\x80\r\n", i);// multi-byte sequences, so some get cut by chunk boundaries
+    {
+        std::ofstream out{path, std::ios::binary};
+        out << contents;
+    }
+
+    Text text{16, 4};
+    FileLoader loader{path, text, 1000, 3};
+    UnitTestPush("Loaded prefix should be searchable before the load has finished", loader.wait_for(100) >= 100 && loader.find("line 1 ").has_value());
+    UnitTestPush("Failed to load file", loader.finish());
+    UnitTestPush("Loaded text does not match file contents", text.buffer().clone_range(0, text.size()) == contents);
+    LineIndex rebuilt;
+    rebuilt.rebuild(text.buffer());
+    UnitTestPush(FORMAT("Line starts built while loading do not match a rebuilt index ({} vs {} lines)", text.lines().line_count(), rebuilt.line_count()), text.lines().starts() == rebuilt.starts());
+    const auto encoding = loader.encoding();
+    UnitTestPush("Encoding should be detected as valid, non-ascii UTF-8", !encoding.ascii && encoding.valid_utf8);
+    UnitTestPush(FORMAT("Expected 2000 CRLF line endings, got {}", encoding.crlf_count), encoding.crlf_count == 2000);
+
+    {
+        // a lone continuation byte
+        std::ofstream out{path, std::ios::binary};
+        out << contents.substr(0, 1500) << '\x80' << contents.substr(1500);
+    }
+    GapBuffer buffer{16, 4};
+    FileLoader invalid{path, buffer, 256};
+    UnitTestPush("Failed to load file", invalid.finish());
+    UnitTestPush("Invalid UTF-8 should be detected", !invalid.encoding().valid_utf8);
+
+    std::filesystem::remove(path);
+    FileLoader missing{path, buffer};
+    UnitTestPush("Loading a missing file should fail", !missing.finish() && missing.error() == LoadError::OpenFailed);
+}
+
+void edit_queue_test() {
+    BeginUnitTest();
+    Text text{16, 4};
+    text.insert_str("hello world");
+    EditQueue queue;
+    queue.drain(text);// publishes the current version
+
+    const auto base = queue.version();
+    queue.submit(base, {TextEdit{0, 5, "goodbye"}});
+    queue.submit(base, {TextEdit{0, 0, "stale "}});// made against the same version, but the edit before it changes the text
+    std::vector<EditRecord> rejected;
+    auto result = queue.drain(text, INT_MAX, [&rejected](EditRecord &&record) { rejected.push_back(std::move(record)); });
+    UnitTestPush(FORMAT("Expected 1 applied & 1 rejected record, got {} & {}", result.applied, result.rejected), result.applied == 1 && result.rejected == 1);
+    UnitTestPush(FORMAT("Unexpected text after drain: {}", text.buffer().clone_range(0, text.size())), text.buffer().clone_range(0, text.size()) == "goodbye world");
+    UnitTestPush("Rejected record should be handed back intact", rejected.size() == 1 && rejected[0].edits.size() == 1 && rejected[0].edits[0].inserted == "stale ");
+    UnitTestPush("Queue should publish the version after draining", queue.version() == text.version());
+
+    // records made against the current version, that apply_edits can't take anyway
+    rejected.clear();
+    queue.submit(queue.version(), {TextEdit{10, 10, "past the end"}});
+    queue.submit(queue.version(), {TextEdit{6, 2, "x"}, TextEdit{0, 1, "unsorted"}});
+    queue.submit(queue.version(), {TextEdit{0, 4, "x"}, TextEdit{2, 1, "overlapping"}});
+    queue.submit(queue.version(), {TextEdit{-1, 1, "negative"}});
+    queue.submit(queue.version(), {TextEdit{0, 1, "G"}, TextEdit{13, 0, "!"}});
+    result = queue.drain(text, INT_MAX, [&rejected](EditRecord &&record) { rejected.push_back(std::move(record)); });
+    UnitTestPush(FORMAT("Expected 1 applied & 4 malformed records, got {} & {}", result.applied, result.rejected), result.applied == 1 && result.rejected == 4 && rejected.size() == 4);
+    UnitTestPush(FORMAT("Unexpected text after draining malformed records: {}", text.buffer().clone_range(0, text.size())), text.buffer().clone_range(0, text.size()) == "Goodbye world!");
+
+    // producers resubmit against the published version until their edit gets in, while the owner keeps draining
+    constexpr auto producers = 4, edits_per_producer = 50;
+    auto applied = 0;
+    std::vector<std::thread> threads;
+    for (auto p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, p] {
+            for (auto i = 0; i < edits_per_producer; i++) queue.submit(queue.version(), {TextEdit{0, 0, std::string(1, static_cast<char>('a' + p))}});
+        });
+    }
+    auto submitted = 0;
+    while (submitted < producers * edits_per_producer) {
+        const auto drained = queue.drain(text);
+        applied += drained.applied;
+        submitted += drained.applied + drained.rejected;
+    }
+    for (auto &thread : threads) thread.join();
+    UnitTestPush(FORMAT("Applied {} edits, but the text grew by {}", applied, text.size() - 14), text.size() - 14 == applied && applied > 0);
+}
+
+void content_hash_test() {
+    BeginUnitTest();
+    const auto path = std::filesystem::temp_directory_path() / "gb_content_hash_test.txt";
+    std::string contents;
+    for (auto i = 0; i < 3000; i++) contents += FORMAT("line number {}\n", i);
+    {
+        std::ofstream out{path, std::ios::binary};
+        out << contents;
+    }
+
+    Text text{16, 4};
+    FileLoader loader{path, text};
+    loader.finish();
+    auto &hash = text.content_hash();
+    hash.mark_saved();
+    const auto on_disk = file_digest(path);
+    UnitTestPush("Digest of the loaded text should match the digest of the file", on_disk.has_value() && *on_disk == hash.digest());
+    UnitTestPush(FORMAT("Text should be split into several blocks, got {}", hash.block_count()), hash.block_count() > 4);
+    UnitTestPush("Freshly saved text should not be modified", !hash.modified() && hash.unsaved_ranges().empty());
+
+    // a same-length change in the middle only leaves its own block unsaved
+    text.move_cursor_to(20001);
+    text.erase_backward(1);
+    text.insert('#');
+    UnitTestPush("Edited text should be modified", hash.modified());
+    const auto unsaved = hash.unsaved_ranges();
+    UnitTestPush(FORMAT("Expected 1 unsaved range around the edit, got {}", unsaved.size()), unsaved.size() == 1 && unsaved[0].begin <= 20000 && unsaved[0].end > 20000 && unsaved[0].end - unsaved[0].begin <= 2 * ContentHash::BlockSize);
+    UnitTestPush("Digest should match the digest of the edited text", hash.digest() == content_digest(text.buffer().clone_range(0, text.size())));
+
+    // undoing the edit by hand makes the text identical to the file again
+    text.erase_backward(1);
+    text.insert(contents[20000]);
+    UnitTestPush("Text edited back to its saved contents should not be modified", !hash.modified() && hash.digest() == *on_disk);
+
+    // an insert shifts everything after it, which then has to be rewritten
+    text.move_cursor_to(100);
+    text.insert_str("inserted");
+    const auto shifted = hash.unsaved_ranges();
+    UnitTestPush("Insert should leave everything from it to the end unsaved", shifted.size() == 1 && shifted[0].begin <= 100 && shifted[0].end == text.size());
+
+    // typing at one spot splits the block there again & again, which only moves the blocks around it into free slots
+    text.move_cursor_to(30000);
+    for (auto i = 0; i < 3000; i++) text.insert_str(FORMAT("typed {}\n", i));
+    const auto typed = text.buffer().clone_range(0, text.size());
+    UnitTestPush("Digest should match after many splits in one place", hash.digest() == content_digest(typed));
+    UnitTestPush(FORMAT("Blocks should stay between half & twice the block size, got {} for {} characters", hash.block_count(), text.size()), hash.block_count() >= text.size() / (2 * ContentHash::BlockSize) && hash.block_count() <= 2 * text.size() / ContentHash::BlockSize + 1);
+    text.erase_range(1000, text.size() - 2000);
+    UnitTestPush("Digest should match after merging most blocks away", hash.digest() == content_digest(text.buffer().clone_range(0, text.size())) && hash.block_count() == 1);
+    std::filesystem::remove(path);
+}
+
+void cold_storage_test() {
+    BeginUnitTest();
+    GapBuffer gb{64, 16};
+    gb.set_growth_policy(GrowthPolicy{.min_capacity = 64, .mmap_threshold = 64 * 1024});
+    gb.set_cold_storage(ColdStorage{.enabled = true, .chunk_size = 16 * 1024, .gap_distance = 32 * 1024, .cache_chunks = 2});
+    std::string expected;
+    for (auto i = 0; expected.size() < 1024 * 1024; i++) expected += FORMAT("{} log line number {}\n", i % 7 == 0 ? "WARN" : "INFO", i);
+    gb.insert_str(expected);
+    gb.move_cursor_to(0);
+    gb.insert('>');
+    expected.insert(0, 1, '>');
+
+    const auto compressed = gb.compress_cold_chunks();
+    UnitTestPush(FORMAT("Expected most of the buffer to be compressed, got {} chunks", compressed), compressed > 40 && gb.cold_chunk_count() == compressed);
+    UnitTestPush(FORMAT("Compressed chunks should take up much less than the text, got {} bytes", gb.cold_bytes()), gb.cold_bytes() < expected.size() / 3);
+
+    // reads go through the read cache, and leave the chunks compressed
+    const GapBuffer &reader = gb;
+    UnitTestPush("Contents do not match with compressed chunks", reader.clone_range(0, reader.size()) == expected);
+    auto chars_match = true;
+    for (auto pos = 0; pos < reader.size(); pos += 4099) chars_match = chars_match && reader.get_at(pos) == expected[pos];
+    UnitTestPush("Characters read from compressed chunks do not match", chars_match);
+    const auto needle = "INFO log line number 30000\n"sv;
+    UnitTestPush("Search through compressed chunks failed", gb.find(needle) == static_cast<int>(expected.find(needle)));
+    UnitTestPush("Reading & searching should leave the chunks compressed", gb.cold_chunk_count() == compressed);
+    // a diff holds on to the segments of the whole buffer, far more than the read cache keeps decompressed
+    UnitTestPush("Diff of a buffer with compressed chunks against the same text should be empty", diff_lines(reader, std::string_view{expected}).hunks.empty());
+    // comparing two ranges of a buffer reads the second while holding on to a segment of the first
+    GapBuffer repeated{64, 16};
+    repeated.set_growth_policy(GrowthPolicy{.min_capacity = 64, .mmap_threshold = 64 * 1024});
+    repeated.set_cold_storage(ColdStorage{.enabled = true, .chunk_size = 16 * 1024, .gap_distance = 16 * 1024, .cache_chunks = 2});
+    const auto block = expected.substr(0, 40 * 1024 + 8);
+    for (auto i = 0; i < 16; i++) repeated.insert_str(block);
+    repeated.compress_cold_chunks();
+    const GapBuffer &repeated_reader = repeated;
+    const auto block_size = static_cast<int>(block.size());
+    UnitTestPush("Equal ranges of a buffer with compressed chunks should compare equal",
+                 segmented::equal(repeated_reader.begin(), repeated_reader.begin() + 4 * block_size, repeated_reader.begin() + 8 * block_size));
+
+    // staged edits are folded in later, when the erased text they turn into gap may still be in compressed chunks
+    gb.set_edit_coalescing(EditCoalescing{.enabled = true, .max_pending_bytes = 1024 * 1024});
+    gb.move_cursor_to(600 * 1024);
+    gb.erase_forward(40000);
+    gb.insert_str(std::string(20000, 'X'));
+    gb.flush_pending_edits();
+    gb.set_edit_coalescing(EditCoalescing{});
+    expected.replace(600 * 1024, 40000, std::string(20000, 'X'));
+    UnitTestPush("Contents do not match after folding staged edits over compressed chunks", reader.clone_range(0, reader.size()) == expected);
+
+    // an edit far from the gap moves it through compressed chunks, which decompresses them for good
+    gb.move_cursor_to(800 * 1024);
+    gb.insert_str("edited");
+    expected.insert(800 * 1024, "edited");
+    UnitTestPush("Chunks the gap moved through should be decompressed", gb.cold_chunk_count() < compressed);
+    UnitTestPush("Contents do not match after editing between compressed chunks", reader.clone_range(0, reader.size()) == expected);
+    gb.set_cold_storage(ColdStorage{});
+    UnitTestPush("Turning cold storage off should decompress everything", gb.cold_chunk_count() == 0 && gb.clone_range(0, gb.size()) == expected);
+}
+
+void display_columns_test() {
+    BeginUnitTest();
+    Text text{64, 16};
+    text.insert_str("a\tb\n\xe4\xb8\xad\xe6\x96\x87x\ne\xcc\x81\tz\n");
+    UnitTestPush(FORMAT("Tab should expand to the next tab stop, got column {}", text.display_column(2)), text.display_column(2) == 4);
+    UnitTestPush("Wide characters should take up two columns", text.display_column(10) == 4);
+    UnitTestPush("Combining marks should take up no columns", text.display_column(15) == 1 && text.display_column(16) == 4);
+    UnitTestPush("Column in the middle of a tab should map to the tab", text.position_at_column(0, 2) == 1);
+    UnitTestPush("Column in the middle of a wide character should map to its first byte", text.position_at_column(1, 3) == 7);
+    UnitTestPush("Column past the end of the line should map to the end of it", text.position_at_column(1, 40) == 11);
+
+    text.set_tab_width(8);
+    UnitTestPush("Changing the tab width should change the columns", text.display_column(2) == 8);
+
+    // a long line has its columns checkpointed, lookups far out on it should still be right after an edit in front of them
+    std::string line;
+    for (auto i = 0; i < 2000; i++) line += i % 3 == 0 ? "\t" : "ab";
+    text.move_cursor_to(text.size());
+    const auto line_start = text.size();
+    text.insert_str(line);
+    auto expected_column = [&line](int offset) {
+        auto column = 0;
+        for (auto i = 0; i < offset; i++) column = line[i] == '\t' ? column + 8 - column % 8 : column + 1;
+        return column;
+    };
+    UnitTestPush("Column far out on a long line is wrong", text.display_column(line_start + 3000) == expected_column(3000));
+    text.move_cursor_to(line_start + 10);
+    text.insert('\t');
+    line.insert(10, 1, '\t');
+    UnitTestPush("Column is wrong after inserting in front of it", text.display_column(line_start + 3000) == expected_column(3000));
+    UnitTestPush("Position of a column is wrong after an edit", text.position_at_column(3, expected_column(2500)) == line_start + 2500);
+}
+
+void bracket_index_test() {
+    BeginUnitTest();
+    Text text{64, 16};
+    text.insert_str("fn main() {\n    let v = [1, (2)];\n}\n");
+    const auto &brackets = text.brackets();
+    UnitTestPush("Opening brace should match the closing one", brackets.match(10) == 34 && brackets.match(34) == 10);
+    UnitTestPush("Brackets of different kinds should not pair up", brackets.match(24) == 31 && brackets.match(28) == 30);
+    UnitTestPush("A position without a bracket has no match", !brackets.match(0).has_value());
+    UnitTestPush("Innermost enclosing pair is wrong", brackets.enclosing(29) == (BracketPair{28, 30}) && brackets.enclosing(26) == (BracketPair{24, 31}));
+    const auto folds = brackets.fold_regions(text.lines());
+    UnitTestPush("Only the multi-line pair should be a fold region", folds.size() == 1 && folds[0] == (BracketPair{10, 34}));
+
+    // a deeply nested document, spanning many blocks: matches are found through the tree
+    std::string json;
+    for (auto i = 0; i < 5000; i++) json += "{\"a\": [";
+    for (auto i = 0; i < 5000; i++) json += "]}";
+    text.clear();
+    text.insert_str(json);
+    UnitTestPush(FORMAT("Expected the index to span many blocks, got {}", brackets.block_count()), brackets.block_count() > 10);
+    UnitTestPush("Outermost brace should match the last character", brackets.match(0) == static_cast<int>(json.size()) - 1);
+    UnitTestPush("Bracket in the middle should match across blocks", brackets.match(7 * 2500) == static_cast<int>(json.size()) - 2 * 2500 - 1);
+
+    // unbalancing the text only rescans the edited block, and changes the matches
+    text.move_cursor_to(1);
+    text.insert('{');
+    UnitTestPush("Unbalanced opening brace should have no match", !brackets.match(0).has_value() && brackets.match(1) == text.size() - 1);
+    text.move_cursor_to(2);
+    text.erase_backward(1);
+    UnitTestPush("Removing the extra brace should rebalance", brackets.match(0) == text.size() - 1 && brackets.bracket_count() == 4 * 5000);
+}
+
+void search_options_test() {
+    BeginUnitTest();
+    constexpr auto content = "Hello World, hello_world, HELLO! Ärger über ÄRGER"sv;
+    const SearchOptions case_insensitive{.case_insensitive = true};
+    const SearchOptions whole_word{.whole_word = true};
+    const SearchOptions both{.case_insensitive = true, .whole_word = true};
+    auto gapBuffers = setup_gapbuffers();
+    for (auto &gb : gapBuffers) gb.insert_str(content);
+    auto gbIndex = 0;
+    for (auto &gb : gapBuffers) {
+        // with the gap in every possible position, so that matches straddle it
+        for (auto i = 0; i <= gb.size(); i++) {
+            gb.move_cursor_to(i);
+            const auto failMsg = FORMAT("Search option failed with the gap at {} in gap buffer {}", i, gbIndex);
+            UnitTestPush(failMsg, gb.find_from("hello WORLD", {}, case_insensitive) == 0 && !gb.find_from("hello WORLD").has_value());
+            UnitTestPush(failMsg, gb.find_from("hello", 1, case_insensitive) == 13 && gb.find_from("hello", 1, both) == 26);
+            UnitTestPush(failMsg, gb.find_from("world", {}, whole_word) == std::nullopt && gb.find_from("World", {}, whole_word) == 6);
+            UnitTestPush(failMsg, gb.find_from("ärger", {}, case_insensitive) == 33 && gb.find_from("äRGER", 34, both) == static_cast<int>(content.find("ÄRGER")));
+            UnitTestPush(failMsg, gb.find("HELLO_WORLD", case_insensitive) == 13);
+        }
+        gbIndex++;
+    }
+}
+
+void replace_range_test() {
+    BeginUnitTest();
+    constexpr auto content = "hello world says c++"sv;
+    auto gapBuffers = setup_gapbuffers();
+    for (auto &gb : gapBuffers) gb.insert_str(content);
+    auto gbIndex = 0;
+    for (auto &gb : gapBuffers) {
+        // with the gap before, inside & after the replaced range
+        for (auto i = 0; i <= gb.size(); i++) {
+            // an insert & erase leaves the gap at the cursor
+            gb.move_cursor_to(i);
+            gb.insert('x');
+            gb.erase_backward(1);
+            const auto capacity = gb.capacity();
+            gb.replace(6, 5, "earth");
+            UnitTestPush(FORMAT("Same-size replace with the gap at {} in gap buffer {} failed", i, gbIndex), gb.clone_range(0, gb.size()) == "hello earth says c++" && gb.capacity() == capacity);
+            gb.replace(6, 5, "world");
+        }
+        gbIndex++;
+    }
+
+    GapBuffer gb{64, 16};
+    gb.insert_str(content);
+    gb.move_cursor_to(0);
+    gb.erase_forward(6);
+    UnitTestPush("erase_forward should erase char_count characters", gb.clone_range(0, gb.size()) == "world says c++");
+    gb.move_cursor_to(gb.size());
+    gb.erase_range(5, 5);
+    UnitTestPush("erase_range failed, or didn't move the cursor back with the text", gb.clone_range(0, gb.size()) == "world c++" && gb.pos() == gb.size());
+
+    // the cursor's line & column follow line breaks written, erased & moved past
+    gb.replace(5, 1, "\nnew\nlines\n");
+    UnitTestPush(FORMAT("Cursor should be on line 3, column 3 after replace, is on {}:{}", gb.line(), gb.col_pos()), gb.line() == 3 && gb.col_pos() == 3);
+    gb.move_cursor_to(8);
+    gb.erase_backward(4);
+    UnitTestPush(FORMAT("Cursor should be on line 0, column 4 after erasing a line break, is on {}:{}", gb.line(), gb.col_pos()), gb.line() == 0 && gb.col_pos() == 4);
+    gb.erase_range(0, 100);
+    UnitTestPush("Cursor should be on line 0, column 0 in an empty buffer", gb.line() == 0 && gb.col_pos() == 0);
+    // an edit on an earlier line only changes the cursor's line, moving back across a line break counts the column from the start of that line
+    gb.insert_str("first\nsecond\nthird");
+    gb.replace(0, 5, "1\n2");
+    UnitTestPush(FORMAT("Cursor should be on line 3, column 5 after an edit on an earlier line, is on {}:{}", gb.line(), gb.col_pos()), gb.line() == 3 && gb.col_pos() == 5);
+    gb.move_cursor_to(7);
+    UnitTestPush(FORMAT("Cursor should be on line 2, column 3 after moving back, is on {}:{}", gb.line(), gb.col_pos()), gb.line() == 2 && gb.col_pos() == 3);
+
+    Text text{64, 16};
+    text.insert_str("one\ntwo\nthree\n");
+    std::vector<ChangeEvent> events;
+    const auto subscription = text.subscribe([&events](std::span<const ChangeEvent> batch) { events.insert(events.end(), batch.begin(), batch.end()); });
+    text.replace(2, 7, "E\nTWO\nTH\n");
+    UnitTestPush("Replace should be delivered as one change event", events.size() == 1 && events[0].removed == 7 && events[0].inserted == 9 && events[0].line_delta == 1);
+    LineIndex rebuilt;
+    rebuilt.rebuild(text.buffer());
+    UnitTestPush("Line index is wrong after a replace", text.lines().starts() == rebuilt.starts() && text.lines().line_count() == 5);
+    text.unsubscribe(subscription);
+}
+
+void fork_test() {
+    BeginUnitTest();
+    GapBuffer original{64, 16};
+    original.set_growth_policy(GrowthPolicy{.min_capacity = 64, .mmap_threshold = 64 * 1024});
+    std::string expected;
+    for (auto i = 0; expected.size() < 1024 * 1024; i++) expected += FORMAT("line number {}\n", i);
+    original.insert_str(expected);
+
+    auto forked = original.fork();
+    UnitTestPush(FORMAT("Expected the fork to share most chunks, got {}", forked.shared_chunk_count()), forked.shared_chunk_count() > 10 && original.shared_chunk_count() > 10);
+    UnitTestPush("Fork doesn't have the same contents", forked.clone_range(0, forked.size()) == expected);
+    UnitTestPush("Reading a fork should copy the chunks it read over from the base", forked.shared_chunk_count() == 0);
+
+    // edits on either side don't show up in the other
+    original.move_cursor_to(original.size());
+    original.insert_str("appended to the original\n");
+    forked.move_cursor_to(100);
+    forked.insert_str("inserted into the fork");
+    UnitTestPush("Original changed by an edit to the fork", original.clone_range(0, original.size()) == expected + "appended to the original\n");
+    UnitTestPush("Fork changed by an edit to the original", forked.clone_range(0, forked.size()) == expected.substr(0, 100) + "inserted into the fork" + expected.substr(100));
+
+    // staged edits folded in over chunks still shared with the base, far from the small gap the buffer was forked with
+    GapBuffer base{64, 16};
+    base.set_growth_policy(GrowthPolicy{.max_gap_size = 64, .min_capacity = 64, .mmap_threshold = 64 * 1024});
+    base.insert_str(expected);
+    base.move_cursor_to(0);
+    base.insert('>');
+    auto staged = base.fork();
+    staged.set_edit_coalescing(EditCoalescing{.enabled = true, .max_pending_bytes = 1024 * 1024});
+    staged.move_cursor_to(600 * 1024);
+    staged.erase_forward(200000);
+    staged.insert_str(std::string(150000, 'Y'));
+    staged.flush_pending_edits();
+    auto staged_expected = ">" + expected;
+    staged_expected.replace(600 * 1024, 200000, std::string(150000, 'Y'));
+    UnitTestPush("Contents do not match after folding staged edits over shared chunks", staged.clone_range(0, staged.size()) == staged_expected);
+    UnitTestPush("Staged edits on a fork changed the buffer it was forked from", base.clone_range(0, base.size()) == ">" + expected);
+
+    // heap allocated buffers are copied
+    GapBuffer small{64, 16};
+    small.insert_str("hello world");
+    small.move_cursor_to(5);
+    auto copy = small.fork();
+    copy.insert_str(",");
+    UnitTestPush("Copy of a heap allocated buffer isn't independent", small.clone_range(0, small.size()) == "hello world" && copy.clone_range(0, copy.size()) == "hello, world");
+}
+
+void line_operations_test() {
+    BeginUnitTest();
+    Text text{64, 16};
+    text.insert_str("int a;  \n\nint b;\t\r\n    int c;\n");
+    auto events = 0;
+    const auto subscription = text.subscribe([&events](std::span<const ChangeEvent> batch) { events += static_cast<int>(batch.size()); });
+
+    indent_lines(text, 0, 3, "    ");
+    UnitTestPush("Indent should skip empty lines", text.buffer().clone_range(0, text.size()) == "    int a;  \n\n    int b;\t\r\n        int c;\n" && events == 1);
+    unindent_lines(text, 0, 3, 4);
+    UnitTestPush("Unindent should undo the indent", text.buffer().clone_range(0, text.size()) == "int a;  \n\nint b;\t\r\n    int c;\n" && events == 2);
+    trim_trailing_whitespace(text, 0, 3);
+    UnitTestPush("Trailing whitespace should be trimmed, keeping CRLF line endings", text.buffer().clone_range(0, text.size()) == "int a;\n\nint b;\r\n    int c;\n" && events == 3);
+    toggle_line_comment(text, 2, 3, "// ");
+    UnitTestPush("Comments should go at the least indented line's indentation", text.buffer().clone_range(0, text.size()) == "int a;\n\n// int b;\r\n//     int c;\n");
+    toggle_line_comment(text, 2, 3, "// ");
+    UnitTestPush("Toggling again should uncomment", text.buffer().clone_range(0, text.size()) == "int a;\n\nint b;\r\n    int c;\n");
+    sort_lines(text, 0, 3, true);
+    UnitTestPush("Sorting should keep the line endings in place", text.buffer().clone_range(0, text.size()) == "int b;\nint a;\n    int c;\r\n\n");
+    trim_trailing_whitespace(text, 0, 3);
+    UnitTestPush("An operation that changes nothing shouldn't make an edit", events == 6);
+    text.unsubscribe(subscription);
+
+    // enough lines for the parallel sort
+    std::string lines;
+    for (auto i = 0; i < 3 * ParallelSortLines; i++) lines += FORMAT("{}\n", (i * 7919) % (3 * ParallelSortLines));
+    text.clear();
+    text.insert_str(lines);
+    sort_lines(text, 0, text.lines().line_count() - 1);
+    auto sorted = true;
+    for (auto line = 1; line + 1 < text.lines().line_count(); line++) {
+        const auto previous = text.buffer().clone_range(text.lines().line_start(line - 1), text.lines().line_start(line) - text.lines().line_start(line - 1));
+        const auto current = text.buffer().clone_range(text.lines().line_start(line), text.lines().line_start(line + 1) - text.lines().line_start(line));
+        sorted = sorted && previous <= current;
+    }
+    UnitTestPush("Large range isn't sorted", sorted && text.size() == static_cast<int>(lines.size()) && text.lines().line_count() == 3 * ParallelSortLines + 1);
+}
+
+void utf16_positions_test() {
+    BeginUnitTest();
+    Text text{64, 16};
+    text.insert_str("a\xc3\xa4" "b\r\n\xf0\x9f\x98\x80x\xe4\xb8\xad\n");
+    UnitTestPush(FORMAT("Two byte character should be one code unit, got {}", text.to_utf16(3).character), (text.to_utf16(3) == Utf16Position{0, 2}));
+    UnitTestPush("Emoji should be a surrogate pair", (text.to_utf16(10) == Utf16Position{1, 2}) && (text.to_utf16(14) == Utf16Position{1, 4}));
+    UnitTestPush("Code unit in the middle of a surrogate pair should map to its start", text.from_utf16({1, 1}) == 6 && text.from_utf16({1, 3}) == 11);
+    UnitTestPush("Character past the end of the line should map to before its line break", text.from_utf16({0, 99}) == 4);
+    UnitTestPush("Line past the end should map to the end of the text", text.from_utf16({5, 0}) == text.size());
+
+    const std::array positions{14, 3, 10};
+    std::array<Utf16Position, 3> converted{};
+    text.to_utf16(positions, converted);
+    UnitTestPush("Unsorted batch should convert like single positions", (converted == std::array<Utf16Position, 3>{{{1, 4}, {0, 2}, {1, 2}}}));
+    std::array<int, 3> back{};
+    text.from_utf16(converted, back);
+    UnitTestPush("Batch should convert back to the same positions", back == positions);
+
+    // a long (minified) line, where conversions far out on it go through the index instead of scanning from the line start
+    std::string line;
+    for (auto i = 0; i < 10000; i++) line += "ab\xe4\xb8\xad";
+    text.move_cursor_to(text.size());
+    const auto line_start = text.size();
+    text.insert_str(line);
+    UnitTestPush("Column far out on a long line is wrong", (text.to_utf16(line_start + 5 * 9000) == Utf16Position{2, 3 * 9000}));
+    text.move_cursor_to(line_start);
+    text.insert_str("\xf0\x9f\x98\x80");
+    UnitTestPush("Column is wrong after inserting in front of it", (text.to_utf16(line_start + 4 + 5 * 9000) == Utf16Position{2, 2 + 3 * 9000}));
+    UnitTestPush("Position of a column is wrong after an edit", text.from_utf16({2, 2 + 3 * 7000}) == line_start + 4 + 5 * 7000);
+}
+
 int main() {
     try {
         remove_forward_backward_test();
@@ -447,6 +1309,25 @@ int main() {
         non_mutating_cursor_ops_test();
         clear_test();
         gb_motions_test();
+        iterators_test();
+        edit_coalescing_test();
+        growth_policy_test();
+        mapped_storage_test();
+        snapshot_test();
+        diff_test();
+        change_events_test();
+        markers_test();
+        file_loader_test();
+        edit_queue_test();
+        content_hash_test();
+        cold_storage_test();
+        display_columns_test();
+        bracket_index_test();
+        search_options_test();
+        replace_range_test();
+        fork_test();
+        line_operations_test();
+        utf16_positions_test();
     } catch(std::exception& e) {
         fmt::print(FMT_STRING("Error caught: {}\n"), e.what());
         fflush(stdout);
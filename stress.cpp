@@ -0,0 +1,608 @@
+#define FMT_ENFORCE_COMPILE_STRING
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <fmt/core.h>
+#include <fmt/format.h>
+#include <fstream>
+#include <gb/gap_buffer.hpp>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std::string_view_literals;
+
+/// Differential stress test. Drives random sequences of edits, cursor movements & searches against a GapBuffer, and against a std::string
+/// (plus a cursor) as the reference model, and stops at the first operation where the two disagree. A failing sequence is shrunk down to
+/// the operations still needed to make it fail, and printed along with its seed, which replays it.
+/// Every operation on the GapBuffer is timed by kind. --record saves those timings, and --baseline fails the run if a kind of operation got
+/// slower than in the baseline by more than --max-slowdown percent. The operations only depend on the seed, so the same arguments do the
+/// same work from one build to the next.
+
+#define FORMAT(str, ...) fmt::format(FMT_STRING(str), __VA_ARGS__)
+
+enum class OpKind : int {
+    Insert,
+    InsertStr,
+    EraseForward,
+    EraseBackward,
+    Replace,
+    EraseRange,
+    MoveTo,
+    MoveForward,
+    MoveBackward,
+    Find,
+    FindFrom,
+    FindCh,
+    ReadAt,
+    CloneRange,
+    Flush,
+    Compress,
+    ShrinkToFit,
+    Fork,
+    Clear,
+    Count
+};
+
+constexpr auto OpKinds = static_cast<int>(OpKind::Count);
+constexpr std::array<std::string_view, OpKinds> op_names{"insert", "insert_str", "erase_forward", "erase_backward", "replace", "erase_range", "move_cursor_to",
+                                                         "move_cursor_forward", "move_cursor_backward", "find", "find_from", "find_ch_from", "get_at", "clone_range",
+                                                         "flush_pending_edits", "compress_cold_chunks", "shrink_to_fit", "fork", "clear"};
+/// How often each kind of operation gets picked, relative to the others
+constexpr std::array<int, OpKinds> op_weights{10, 14, 8, 8, 10, 4, 10, 4, 4, 5, 6, 3, 4, 3, 2, 2, 1, 1, 1};
+
+/// Positions & lengths are kept as raw random numbers, and only turned into positions against the text an operation gets applied to, so that
+/// any subsequence of a run's operations (which is what shrinking produces) is still a valid run
+struct Op {
+    OpKind kind;
+    std::uint32_t a;
+    std::uint32_t b;
+    std::string text;
+    SearchOptions options;
+};
+
+/// Mapped buffers share their chunks when forked (see GapBuffer::fork), cold ones compress them as well
+enum class Storage { Heap, Mapped, Cold };
+constexpr std::array<std::string_view, 3> storage_names{"heap", "mapped", "cold"};
+
+/// Everything about a run that isn't its operations
+struct Case {
+    std::uint64_t seed;
+    Storage storage;
+    int capacity;
+    int gap_size;
+    /// Picked independently of storage, as staged edits get folded into whatever the storage is at that point
+    EditCoalescing coalescing;
+    /// For mapped & cold storage: whether growing leaves a gap of at most 64 bytes, so that erasing turns text far from the gap into gap
+    bool small_gap;
+    std::string initial;
+};
+
+struct Failure {
+    /// Index of the operation that failed
+    int op;
+    std::string message;
+};
+
+struct Timing {
+    std::int64_t nanoseconds{0};
+    std::int64_t count{0};
+};
+
+using Timings = std::array<Timing, OpKinds>;
+
+/// splitmix64; unlike the std:: distributions, it generates the same numbers with every compiler & standard library, which replaying a seed relies on
+class Random {
+public:
+    explicit Random(std::uint64_t seed) : state(seed) {}
+
+    std::uint64_t next() {
+        auto z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    /// In [0, bound)
+    std::uint32_t below(std::uint32_t bound) {
+        return static_cast<std::uint32_t>(next() % bound);
+    }
+
+    bool chance(int percent) {
+        return below(100) < static_cast<std::uint32_t>(percent);
+    }
+
+private:
+    std::uint64_t state;
+};
+
+namespace {
+    /// Besides ASCII, the text has Ä & ä in it, so that case insensitive search gets to fold UTF-8, and edits get to split characters in two
+    constexpr std::array<std::string_view, 12> alphabet{"a", "A", "b", "B", "_", " ", "1", "\n", "\t", "\r\n", "\xc3\x84", "\xc3\xa4"};
+
+    std::string random_text(Random &random, int max_length) {
+        std::string text;
+        const auto length = static_cast<int>(random.below(static_cast<std::uint32_t>(max_length) + 1));
+        while (static_cast<int>(text.size()) < length) text += alphabet[random.below(alphabet.size())];
+        return text;
+    }
+
+    std::string escape(std::string_view text) {
+        std::string result;
+        for (auto ch : text) {
+            if (ch == '\n') result += "\\n";
+            else if (ch == '\r') result += "\\r";
+            else if (ch == '\t') result += "\\t";
+            else if (ch == '"' || ch == '\\') result += {'\\', ch};
+            else if (static_cast<unsigned char>(ch) >= 0x80) result += FORMAT("\\x{:02x}", static_cast<unsigned char>(ch));
+            else result += ch;
+        }
+        return result;
+    }
+
+    Case make_case(std::uint64_t seed) {
+        Random random{seed};
+        Case test{.seed = seed, .storage = static_cast<Storage>(random.below(3)), .capacity = 0, .gap_size = 0, .coalescing = {}, .small_gap = false, .initial = {}};
+        test.capacity = 1 + static_cast<int>(random.below(128));
+        test.gap_size = 1 + static_cast<int>(random.below(64));
+        if (random.chance(50)) {
+            test.coalescing = EditCoalescing{.enabled = true, .max_pending_edits = 1 + static_cast<int>(random.below(32)), .max_pending_bytes = 16 + static_cast<int>(random.below(4096))};
+        }
+        test.small_gap = test.storage != Storage::Heap && random.chance(50);
+        // buffers are only mapped past the mmap threshold, and cold storage only kicks in for the chunks far enough from the gap, so those runs start out large
+        const auto initial_length = test.storage != Storage::Heap ? 256 * 1024 : static_cast<int>(random.below(512));
+        while (static_cast<int>(test.initial.size()) < initial_length) test.initial += random_text(random, 64);
+        return test;
+    }
+
+    std::vector<Op> make_ops(std::uint64_t seed, int count) {
+        // a different stream than make_case's, so that changing the number of operations leaves the case alone
+        Random random{seed ^ 0x5eed5eed5eed5eedull};
+        const auto total_weight = [] { auto sum = 0; for (auto w : op_weights) sum += w; return sum; }();
+        std::vector<Op> ops;
+        ops.reserve(count);
+        for (auto i = 0; i < count; i++) {
+            auto pick = static_cast<int>(random.below(total_weight));
+            auto kind = 0;
+            while (pick >= op_weights[kind]) pick -= op_weights[kind++];
+            Op op{.kind = static_cast<OpKind>(kind), .a = static_cast<std::uint32_t>(random.next()), .b = 0, .text = {}, .options = {}};
+            // lengths are mostly small, with the occasional one large enough to cross chunks, segments & the pending edit limits. Long erases &
+            // long insertions are about as likely & as long, so that the runs starting out with a large text don't whittle it down to nothing
+            op.b = random.chance(5) ? random.below(8 * 1024) : random.below(24);
+            if (op.kind == OpKind::InsertStr || op.kind == OpKind::Replace) op.text = random_text(random, random.chance(5) ? 8 * 1024 : 16);
+            if (op.kind == OpKind::Insert || op.kind == OpKind::FindCh) op.text = alphabet[random.below(alphabet.size())].substr(0, 1);
+            if (op.kind == OpKind::Find || op.kind == OpKind::FindFrom) {
+                // half of the needles are taken from the text when the search runs (see needle_for), so that most searches find something
+                if (random.chance(50)) op.text = random_text(random, 4);
+                op.options = SearchOptions{.case_insensitive = random.chance(50), .whole_word = random.chance(30)};
+            }
+            ops.push_back(std::move(op));
+        }
+        return ops;
+    }
+
+    std::unique_ptr<GapBuffer> make_buffer(const Case &test) {
+        auto buffer = std::make_unique<GapBuffer>(test.capacity, test.gap_size);
+        if (test.storage != Storage::Heap) {
+            buffer->set_growth_policy(GrowthPolicy{.max_gap_size = test.small_gap ? 64 : GrowthPolicy{}.max_gap_size, .min_capacity = 64, .mmap_threshold = 64 * 1024});
+            // forks share their text in chunks of the cold storage chunk size, whether cold storage is on or not
+            buffer->set_cold_storage(ColdStorage{.enabled = test.storage == Storage::Cold, .chunk_size = 4096, .gap_distance = 16 * 1024, .cache_chunks = 2});
+        }
+        buffer->set_edit_coalescing(test.coalescing);
+        buffer->insert_str(test.initial);
+        buffer->move_cursor_to(0);
+        return buffer;
+    }
+
+    char ascii_lower(char ch) {
+        return ch >= 'A' && ch <= 'Z' ? static_cast<char>(ch + ('a' - 'A')) : ch;
+    }
+
+    bool is_word_char(char ch) {
+        return static_cast<unsigned char>(ch) >= 0x80 || (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+    }
+
+    /// Case folds the characters of the alphabet, as (folded character, length) pairs. Ä & ä only count as a character when both of their
+    /// bytes are in text; on their own, their bytes compare as themselves
+    std::vector<std::pair<int, int>> fold(std::string_view text) {
+        std::vector<std::pair<int, int>> folded;
+        for (std::size_t i = 0; i < text.size();) {
+            if (text[i] == '\xc3' && i + 1 < text.size() && (text[i + 1] == '\x84' || text[i + 1] == '\xa4')) {
+                folded.emplace_back(0xe4, 2);
+                i += 2;
+            } else {
+                folded.emplace_back(static_cast<unsigned char>(ascii_lower(text[i])), 1);
+                i++;
+            }
+        }
+        return folded;
+    }
+
+    /// The model's answer to find & find_from: a plain scan, comparing each candidate in full
+    std::optional<int> reference_find(std::string_view text, std::string_view needle, int from, SearchOptions options) {
+        const auto size = static_cast<int>(text.size());
+        const auto length = static_cast<int>(needle.size());
+        if (length == 0) return {};
+        const auto folded_needle = fold(needle);
+        for (auto i = std::max(from, 0); i + length <= size; i++) {
+            const auto candidate = text.substr(i, length);
+            if (options.case_insensitive ? fold(candidate) != folded_needle : candidate != needle) continue;
+            if (options.whole_word && ((i > 0 && is_word_char(text[i - 1])) || (i + length < size && is_word_char(text[i + length])))) continue;
+            return i;
+        }
+        return {};
+    }
+
+    std::string describe(std::optional<int> result) {
+        return result ? FORMAT("{}", *result) : std::string{"none"};
+    }
+
+    class Runner {
+    public:
+        Runner(const Case &test, Timings *timings, bool trace) : test(test), timings(timings), trace(trace) {}
+
+        std::optional<Failure> run(std::span<const Op> ops) {
+            buffer = make_buffer(test);
+            model = test.initial;
+            cursor = 0;
+            for (auto i = 0; i < static_cast<int>(ops.size()); i++) {
+                if (auto message = apply(ops[i])) return Failure{i, std::move(*message)};
+                if (auto message = check(i % 64 == 0)) return Failure{i, std::move(*message)};
+            }
+            if (auto message = check(true)) return Failure{static_cast<int>(ops.size()) - 1, std::move(*message)};
+            return {};
+        }
+
+    private:
+        template<typename Fn>
+        auto timed(OpKind kind, Fn fn) {
+            const auto begin = std::chrono::steady_clock::now();
+            if constexpr (std::is_void_v<decltype(fn())>) {
+                fn();
+                record(kind, begin);
+            } else {
+                auto result = fn();
+                record(kind, begin);
+                return result;
+            }
+        }
+
+        void record(OpKind kind, std::chrono::steady_clock::time_point begin) {
+            if (!timings) return;
+            auto &timing = (*timings)[static_cast<int>(kind)];
+            timing.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+            timing.count++;
+        }
+
+        int size() const {
+            return static_cast<int>(model.size());
+        }
+
+        /// A position in [0, size()]
+        int position(std::uint32_t raw) const {
+            return static_cast<int>(raw % (static_cast<std::uint32_t>(size()) + 1));
+        }
+
+        std::string needle_for(const Op &op) const {
+            if (!op.text.empty() || model.empty()) return op.text;
+            const auto begin = static_cast<int>(op.a % model.size());
+            return model.substr(begin, 1 + op.b % 6);
+        }
+
+        template<typename... Args>
+        void log(fmt::format_string<Args...> format, Args &&...args) {
+            if (trace) fmt::print(FMT_STRING("    {}\n"), fmt::format(format, std::forward<Args>(args)...));
+        }
+
+        std::optional<std::string> apply(const Op &op) {
+            const GapBuffer &reader = *buffer;
+            switch (op.kind) {
+                case OpKind::Insert:
+                    log("insert('{}')", escape(op.text));
+                    timed(op.kind, [&] { buffer->insert(op.text[0]); });
+                    model.insert(cursor++, 1, op.text[0]);
+                    break;
+                case OpKind::InsertStr:
+                    log("insert_str(\"{}\")", escape(op.text));
+                    timed(op.kind, [&] { buffer->insert_str(op.text); });
+                    model.insert(cursor, op.text);
+                    cursor += static_cast<int>(op.text.size());
+                    break;
+                case OpKind::EraseForward: {
+                    const auto count = static_cast<int>(op.b);
+                    log("erase_forward({})", count);
+                    timed(op.kind, [&] { buffer->erase_forward(count); });
+                    model.erase(cursor, std::min(count, size() - cursor));
+                    break;
+                }
+                case OpKind::EraseBackward: {
+                    const auto count = static_cast<int>(op.b);
+                    log("erase_backward({})", count);
+                    timed(op.kind, [&] { buffer->erase_backward(count); });
+                    const auto begin = std::max(cursor - count, 0);
+                    model.erase(begin, cursor - begin);
+                    cursor = begin;
+                    break;
+                }
+                case OpKind::Replace:
+                case OpKind::EraseRange: {
+                    const auto pos = position(op.a);
+                    const auto length = std::min(static_cast<int>(op.b), size() - pos);
+                    const auto inserted = static_cast<int>(op.text.size());
+                    if (op.kind == OpKind::Replace) {
+                        log("replace({}, {}, \"{}\")", pos, op.b, escape(op.text));
+                        timed(op.kind, [&] { buffer->replace(pos, static_cast<int>(op.b), op.text); });
+                    } else {
+                        log("erase_range({}, {})", pos, op.b);
+                        timed(op.kind, [&] { buffer->erase_range(pos, static_cast<int>(op.b)); });
+                    }
+                    model.replace(pos, length, op.text);
+                    if (cursor >= pos + length) cursor += inserted - length;
+                    else if (cursor > pos) cursor = pos + inserted;
+                    break;
+                }
+                case OpKind::MoveTo:
+                    cursor = position(op.a);
+                    log("move_cursor_to({})", cursor);
+                    timed(op.kind, [&] { buffer->move_cursor_to(cursor); });
+                    break;
+                case OpKind::MoveForward:
+                    log("move_cursor_forward({})", op.b);
+                    timed(op.kind, [&] { buffer->move_cursor_forward(static_cast<int>(op.b)); });
+                    cursor = std::min(cursor + static_cast<int>(op.b), size());
+                    break;
+                case OpKind::MoveBackward:
+                    log("move_cursor_backward({})", op.b);
+                    timed(op.kind, [&] { buffer->move_cursor_backward(static_cast<int>(op.b)); });
+                    cursor = std::max(cursor - static_cast<int>(op.b), 0);
+                    break;
+                case OpKind::Find:
+                case OpKind::FindFrom: {
+                    const auto needle = needle_for(op);
+                    const auto from = op.kind == OpKind::Find ? 0 : static_cast<int>(op.a % (model.size() + 8)) - 4;
+                    log("{}(\"{}\", {}, {{.case_insensitive = {}, .whole_word = {}}})", op_names[static_cast<int>(op.kind)], escape(needle), from, op.options.case_insensitive, op.options.whole_word);
+                    const auto found = op.kind == OpKind::Find ? timed(op.kind, [&] { return buffer->find(needle, op.options); })
+                                                               : timed(op.kind, [&] { return reader.find_from(needle, from, op.options); });
+                    const auto expected = reference_find(model, needle, from, op.options);
+                    if (found != expected) return FORMAT("{} for \"{}\" returned {}, expected {}", op_names[static_cast<int>(op.kind)], escape(needle), describe(found), describe(expected));
+                    break;
+                }
+                case OpKind::FindCh: {
+                    const auto from = position(op.a);
+                    log("find_ch_from('{}', {})", escape(op.text), from);
+                    const auto found = timed(op.kind, [&] { return reader.find_ch_from(op.text[0], from); });
+                    const auto at = model.find(op.text[0], from);
+                    const auto expected = at == std::string::npos ? std::optional<int>{} : static_cast<int>(at);
+                    if (found != expected) return FORMAT("find_ch_from returned {}, expected {}", describe(found), describe(expected));
+                    break;
+                }
+                case OpKind::ReadAt: {
+                    if (model.empty()) break;
+                    const auto pos = static_cast<int>(op.a % model.size());
+                    log("get_at({})", pos);
+                    const auto ch = timed(op.kind, [&] { return reader.get_at(pos); });
+                    if (ch != model[pos]) return FORMAT("get_at({}) returned '{}', expected '{}'", pos, escape({&ch, 1}), escape({&model[pos], 1}));
+                    break;
+                }
+                case OpKind::CloneRange: {
+                    const auto begin = position(op.a);
+                    const auto length = std::min(static_cast<int>(op.b), size() - begin);
+                    log("clone_range({}, {})", begin, length);
+                    const auto cloned = timed(op.kind, [&] { return reader.clone_range(begin, length); });
+                    if (cloned != std::string_view{model}.substr(begin, length)) return FORMAT("clone_range({}, {}) returned the wrong text", begin, length);
+                    break;
+                }
+                case OpKind::Flush:
+                    log("flush_pending_edits()");
+                    timed(op.kind, [&] { buffer->flush_pending_edits(); });
+                    if (buffer->pending_edit_count() != 0) return FORMAT("{} edits still pending after a flush", buffer->pending_edit_count());
+                    break;
+                case OpKind::Compress:
+                    log("compress_cold_chunks()");
+                    timed(op.kind, [&] { buffer->compress_cold_chunks(); });
+                    break;
+                case OpKind::ShrinkToFit:
+                    log("shrink_to_fit()");
+                    timed(op.kind, [&] { buffer->shrink_to_fit(); });
+                    if (buffer->capacity() < buffer->size()) return FORMAT("shrink_to_fit left a capacity of {} for {} characters", buffer->capacity(), buffer->size());
+                    break;
+                case OpKind::Fork: {
+                    // carries on with either the original or the fork, after an edit to the other one, which must not show up in it
+                    const auto keep_fork = op.b % 2 == 1;
+                    log("fork(), carrying on with the {}", keep_fork ? "fork" : "original");
+                    auto forked = timed(op.kind, [&] { return std::make_unique<GapBuffer>(buffer->fork()); });
+                    if (keep_fork) std::swap(buffer, forked);
+                    forked->move_cursor_to(0);
+                    forked->erase_range(0, forked->size() / 2);
+                    forked->insert_str("written to the other side of a fork");
+                    // reading the contents would copy over every chunk still shared with the base, which later edits are meant to run into; the
+                    // next full check (see run) compares them
+                    if (auto message = check(false)) return FORMAT("{}, after editing the other side of a fork", *message);
+                    break;
+                }
+                case OpKind::Clear:
+                    log("clear()");
+                    timed(op.kind, [&] { buffer->clear(); });
+                    model.clear();
+                    cursor = 0;
+                    if (test.storage != Storage::Heap) {
+                        // mapped & cold storage only do anything for large texts, so those runs load their text again
+                        log("insert_str(<{} initial characters>), move_cursor_to(0)", test.initial.size());
+                        buffer->insert_str(test.initial);
+                        buffer->move_cursor_to(0);
+                        model = test.initial;
+                    }
+                    break;
+                case OpKind::Count:
+                    break;
+            }
+            return {};
+        }
+
+        /// Size & cursor are checked after every operation. Comparing the whole text & the cursor's line & column is, for large buffers, left to every so often
+        std::optional<std::string> check(bool full) const {
+            const GapBuffer &reader = *buffer;
+            if (reader.size() != size()) return FORMAT("size is {}, expected {}", reader.size(), size());
+            if (reader.pos() != cursor) return FORMAT("cursor is at {}, expected {}", reader.pos(), cursor);
+            if (!full && size() > 4096) return {};
+            const auto line = static_cast<int>(std::count(model.begin(), model.begin() + cursor, '\n'));
+            const auto line_break = cursor == 0 ? std::string::npos : model.rfind('\n', cursor - 1);
+            const auto col = line_break == std::string::npos ? cursor : cursor - static_cast<int>(line_break) - 1;
+            if (reader.line() != line || reader.col_pos() != col) return FORMAT("cursor is on {}:{}, expected {}:{}", reader.line(), reader.col_pos(), line, col);
+            const auto contents = reader.clone_range(0, reader.size());
+            if (contents == model) return {};
+            const auto mismatch = std::mismatch(contents.begin(), contents.end(), model.begin()).first - contents.begin();
+            return FORMAT("contents differ from position {}", mismatch);
+        }
+
+        const Case &test;
+        Timings *timings;
+        bool trace;
+        std::unique_ptr<GapBuffer> buffer;
+        std::string model;
+        int cursor{0};
+    };
+
+    /// Delta debugging: removes ever smaller runs of operations, keeping each removal after which the sequence still fails
+    std::vector<Op> shrink(const Case &test, std::vector<Op> ops, Failure &failure) {
+        ops.resize(failure.op + 1);
+        for (auto chunk = static_cast<int>(ops.size()) / 2; chunk >= 1; chunk /= 2) {
+            for (auto begin = 0; begin < static_cast<int>(ops.size());) {
+                auto candidate = ops;
+                candidate.erase(candidate.begin() + begin, candidate.begin() + std::min(begin + chunk, static_cast<int>(candidate.size())));
+                if (auto result = Runner{test, nullptr, false}.run(candidate)) {
+                    candidate.resize(result->op + 1);
+                    ops = std::move(candidate);
+                    failure = std::move(*result);
+                } else {
+                    begin += chunk;
+                }
+            }
+        }
+        return ops;
+    }
+
+    std::map<std::string, double, std::less<>> read_baseline(const std::string &path) {
+        std::map<std::string, double, std::less<>> baseline;
+        std::ifstream file{path};
+        std::string name;
+        double nanoseconds;
+        std::int64_t count;
+        while (file >> name >> nanoseconds >> count) baseline[name] = nanoseconds;
+        return baseline;
+    }
+
+    /// A crash can't be shrunk in process, so it reports the seed of the run it happened in, to replay it in a debugger. Under AddressSanitizer
+    /// this takes ASAN_OPTIONS=abort_on_error=1, as it exits without raising a signal otherwise
+    char crash_note[64] = "";
+
+    void report_crash(int signal) {
+        std::fputs(crash_note, stderr);
+        std::signal(signal, SIG_DFL);
+        std::raise(signal);
+    }
+
+    struct Settings {
+        std::uint64_t seed{1};
+        int runs{500};
+        int ops{2000};
+        std::optional<std::string> baseline;
+        std::optional<std::string> record;
+        double max_slowdown{10.0};
+        /// Kinds of operation with fewer samples than this are too noisy to compare against a baseline
+        std::int64_t min_samples{1000};
+    };
+
+    template<typename T>
+    bool parse(std::string_view arg, T &value) {
+        const auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), value);
+        return ec == std::errc{} && ptr == arg.data() + arg.size();
+    }
+
+    std::optional<Settings> parse_arguments(int argc, char **argv) {
+        Settings settings;
+        for (auto i = 1; i < argc; i++) {
+            const std::string_view arg{argv[i]};
+            if (i + 1 == argc) return {};
+            const std::string_view value{argv[++i]};
+            auto ok = true;
+            if (arg == "--seed") ok = parse(value, settings.seed);
+            else if (arg == "--runs") ok = parse(value, settings.runs);
+            else if (arg == "--ops") ok = parse(value, settings.ops);
+            else if (arg == "--baseline") settings.baseline = std::string{value};
+            else if (arg == "--record") settings.record = std::string{value};
+            else if (arg == "--max-slowdown") ok = parse(value, settings.max_slowdown);
+            else if (arg == "--min-samples") ok = parse(value, settings.min_samples);
+            else ok = false;
+            if (!ok) return {};
+        }
+        return settings;
+    }
+}// namespace
+
+int main(int argc, char **argv) {
+    const auto settings = parse_arguments(argc, argv);
+    if (!settings) {
+        fmt::print(FMT_STRING("usage: {} [--seed N] [--runs N] [--ops N] [--baseline FILE] [--record FILE] [--max-slowdown PERCENT] [--min-samples N]\n"
+                              "  runs --runs cases, with seeds --seed, --seed + 1, ..., of --ops random operations each. Replay a failing case with its seed & --runs 1\n"),
+                   argv[0]);
+        return 2;
+    }
+
+    std::signal(SIGSEGV, report_crash);
+    std::signal(SIGABRT, report_crash);
+    Timings timings{};
+    for (auto run = 0; run < settings->runs; run++) {
+        const auto seed = settings->seed + static_cast<std::uint64_t>(run);
+        const auto test = make_case(seed);
+        const auto ops = make_ops(seed, settings->ops);
+        fmt::format_to_n(crash_note, sizeof(crash_note) - 1, FMT_STRING("crashed in the run with seed {}\n"), seed);
+        auto failure = Runner{test, &timings, false}.run(ops);
+        if (!failure) continue;
+
+        fmt::print(FMT_STRING("seed {} ({} buffer{}{}, {} initial characters) failed at operation {}: {}\n"), seed, storage_names[static_cast<int>(test.storage)],
+                   test.coalescing.enabled ? ", coalescing" : "", test.small_gap ? ", small gap" : "", test.initial.size(), failure->op, failure->message);
+        const auto shrunk = shrink(test, ops, *failure);
+        fmt::print(FMT_STRING("shrunk to {} operations, failing with: {}\n"), shrunk.size(), failure->message);
+        Runner{test, nullptr, true}.run(shrunk);
+        return 1;
+    }
+
+    std::int64_t total = 0;
+    for (const auto &timing : timings) total += timing.count;
+    fmt::print(FMT_STRING("{} runs, {} operations, no mismatches\n"), settings->runs, total);
+
+    if (settings->record) {
+        std::ofstream file{*settings->record};
+        for (auto kind = 0; kind < OpKinds; kind++) {
+            const auto &timing = timings[kind];
+            if (timing.count == 0) continue;
+            file << op_names[kind] << ' ' << static_cast<double>(timing.nanoseconds) / static_cast<double>(timing.count) << ' ' << timing.count << '\n';
+        }
+    }
+
+    if (!settings->baseline) return 0;
+    const auto baseline = read_baseline(*settings->baseline);
+    auto regressed = false;
+    for (auto kind = 0; kind < OpKinds; kind++) {
+        const auto &timing = timings[kind];
+        const auto it = baseline.find(op_names[kind]);
+        if (timing.count < settings->min_samples || it == baseline.end() || it->second <= 0) continue;
+        const auto current = static_cast<double>(timing.nanoseconds) / static_cast<double>(timing.count);
+        const auto change = (current / it->second - 1.0) * 100.0;
+        const auto slower = change > settings->max_slowdown;
+        regressed = regressed || slower;
+        fmt::print(FMT_STRING("{:<22} {:>10.1f} ns/op, baseline {:>10.1f} ns/op, {:+.1f}%{}\n"), op_names[kind], current, it->second, change, slower ? "  SLOWER" : "");
+    }
+    if (regressed) fmt::print(FMT_STRING("slower than the baseline by more than {}%\n"), settings->max_slowdown);
+    return regressed ? 3 : 0;
+}